@@ -6,3 +6,4 @@
 include(CMakeDependentOption)
 
 option(UNIFEX_BUILD_EXAMPLES "Builds the libunifex examples." ON)
+option(UNIFEX_STATIC_THREAD_POOL_STATS "Collects runtime statistics in static_thread_pool." OFF)
@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <unifex/config.hpp>
+
+#if !UNIFEX_NO_LIBURING
+
+#include <unifex/defer.hpp>
+#include <unifex/inplace_stop_token.hpp>
+#include <unifex/just_from.hpp>
+#include <unifex/let_value.hpp>
+#include <unifex/linux/io_uring_context.hpp>
+#include <unifex/repeat_effect_until.hpp>
+#include <unifex/scope_guard.hpp>
+#include <unifex/sequence.hpp>
+#include <unifex/socket_concepts.hpp>
+#include <unifex/sync_wait.hpp>
+#include <unifex/then.hpp>
+#include <unifex/when_all.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+using namespace unifex;
+using namespace unifex::linuxos;
+
+// Measures round-trip latency and throughput of small messages echoed over
+// loopback TCP connections, with both ends of every connection driven by the
+// same io_uring_context.
+
+namespace {
+constexpr std::size_t connectionCount = 4;
+constexpr int roundTripsPerConnection = 5'000;
+constexpr std::size_t messageSize = 64;
+
+using clock_type = std::chrono::steady_clock;
+using socket_t = io_uring_context::async_socket;
+
+struct server_connection {
+  std::optional<socket_t> socket;
+  std::array<std::byte, messageSize> buffer{};
+  bool closed = false;
+};
+
+struct client_connection {
+  std::optional<socket_t> socket;
+  std::array<std::byte, messageSize> message{};
+  std::array<std::byte, messageSize> reply{};
+  std::size_t received = 0;
+  int roundTrips = 0;
+  clock_type::time_point sent;
+};
+
+// Accept a connection and echo everything received on it until the peer
+// shuts down its end.
+auto serve(socket_t& listener, server_connection& c) {
+  return sequence(
+      then(
+          async_accept(listener),
+          [&c](socket_t socket) { c.socket.emplace(std::move(socket)); }),
+      repeat_effect_until(
+          defer([&c] {
+            return let_value(
+                async_read_some(*c.socket, span{c.buffer}),
+                [&c](ssize_t bytesRead) {
+                  c.closed = bytesRead == 0;
+                  return then(
+                      async_write_some(
+                          *c.socket,
+                          as_bytes(span{c.buffer.data(),
+                                        static_cast<std::size_t>(bytesRead)})),
+                      [](ssize_t) {});
+                });
+          }),
+          [&c] { return c.closed; }));
+}
+
+auto round_trip(client_connection& c, std::vector<clock_type::duration>& latencies) {
+  return defer([&] {
+    c.sent = clock_type::now();
+    c.received = 0;
+    return sequence(
+        then(
+            async_write_some(*c.socket, as_bytes(span{c.message})),
+            [](ssize_t bytesWritten) {
+              if (bytesWritten != static_cast<ssize_t>(messageSize)) {
+                throw std::runtime_error("short write");
+              }
+            }),
+        repeat_effect_until(
+            defer([&c] {
+              return then(
+                  async_read_some(
+                      *c.socket,
+                      span{c.reply.data() + c.received,
+                           messageSize - c.received}),
+                  [&c](ssize_t bytesRead) {
+                    if (bytesRead == 0) {
+                      throw std::runtime_error("connection closed");
+                    }
+                    c.received += static_cast<std::size_t>(bytesRead);
+                  });
+            }),
+            [&c] { return c.received == messageSize; }),
+        just_from([&] { latencies.push_back(clock_type::now() - c.sent); }));
+  });
+}
+
+auto run_client(
+    client_connection& c,
+    const sockaddr_in& address,
+    std::vector<clock_type::duration>& latencies) {
+  return sequence(
+      async_connect(
+          *c.socket,
+          reinterpret_cast<const sockaddr*>(&address),
+          static_cast<socklen_t>(sizeof(address))),
+      repeat_effect_until(
+          round_trip(c, latencies),
+          [&c] { return ++c.roundTrips == roundTripsPerConnection; }),
+      just_from([&c] { ::shutdown(c.socket->native_handle(), SHUT_WR); }));
+}
+
+template <std::size_t... Is>
+auto run_all(
+    socket_t& listener,
+    std::array<server_connection, connectionCount>& servers,
+    std::array<client_connection, connectionCount>& clients,
+    const sockaddr_in& address,
+    std::vector<clock_type::duration>& latencies,
+    std::index_sequence<Is...>) {
+  return when_all(
+      serve(listener, servers[Is])...,
+      run_client(clients[Is], address, latencies)...);
+}
+
+double to_us(clock_type::duration d) {
+  return std::chrono::duration<double, std::micro>(d).count();
+}
+
+bool run_benchmark(const char* name, const io_uring_context::options& opts) {
+  io_uring_context ctx{opts};
+
+  inplace_stop_source stopSource;
+  std::thread t{[&] { ctx.run(stopSource.get_token()); }};
+  scope_guard stopOnExit = [&]() noexcept {
+    stopSource.request_stop();
+    t.join();
+  };
+
+  auto scheduler = ctx.get_scheduler();
+
+  try {
+    socket_t listener = open_socket(scheduler, AF_INET, SOCK_STREAM);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    socklen_t addressLength = sizeof(address);
+    if (::bind(
+            listener.native_handle(),
+            reinterpret_cast<const sockaddr*>(&address),
+            sizeof(address)) < 0 ||
+        ::listen(listener.native_handle(), connectionCount) < 0 ||
+        ::getsockname(
+            listener.native_handle(),
+            reinterpret_cast<sockaddr*>(&address),
+            &addressLength) < 0) {
+      throw std::system_error{errno, std::system_category()};
+    }
+
+    std::array<server_connection, connectionCount> servers;
+    std::array<client_connection, connectionCount> clients;
+    for (auto& c : clients) {
+      c.socket.emplace(open_socket(scheduler, AF_INET, SOCK_STREAM));
+    }
+    std::vector<clock_type::duration> latencies;
+    latencies.reserve(connectionCount * roundTripsPerConnection);
+
+    const auto start = clock_type::now();
+    sync_wait(run_all(
+        listener,
+        servers,
+        clients,
+        address,
+        latencies,
+        std::make_index_sequence<connectionCount>{}));
+    const auto elapsed = clock_type::now() - start;
+
+    std::sort(latencies.begin(), latencies.end());
+    const auto count = latencies.size();
+    const double seconds = std::chrono::duration<double>(elapsed).count();
+    std::printf(
+        "%s: %zu connections, %zu round trips of %zu bytes in %.0f ms\n",
+        name,
+        connectionCount,
+        count,
+        messageSize,
+        seconds * 1000);
+    std::printf(
+        "throughput: %.0f round trips/s (%.2f MB/s each way)\n",
+        count / seconds,
+        count * messageSize / seconds / 1e6);
+    if (count != 0) {
+      std::printf(
+          "latency: p50 %.1f us, p99 %.1f us, max %.1f us\n",
+          to_us(latencies[count / 2]),
+          to_us(latencies[count * 99 / 100]),
+          to_us(latencies.back()));
+    }
+  } catch (const std::exception& ex) {
+    std::printf("%s: error: %s\n", name, ex.what());
+    return false;
+  }
+
+  return true;
+}
+} // namespace
+
+int main() {
+  io_uring_context::options defaults;
+  if (!run_benchmark("default", defaults)) {
+    return 1;
+  }
+
+  // Submissions are picked up by a kernel thread rather than io_uring_enter().
+  io_uring_context::options sqPoll;
+  sqPoll.sqPoll = true;
+  sqPoll.sqPollIdle = std::chrono::milliseconds{100};
+  if (!run_benchmark("sqpoll", sqPoll)) {
+    return 1;
+  }
+
+  return 0;
+}
+
+#else // UNIFEX_NO_LIBURING
+
+#include <cstdio>
+int main() {
+  printf("liburing support not found\n");
+  return 0;
+}
+
+#endif // UNIFEX_NO_LIBURING
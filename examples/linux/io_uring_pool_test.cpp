@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unifex/config.hpp>
+
+#if !UNIFEX_NO_LIBURING
+
+#include <unifex/just.hpp>
+#include <unifex/let_value.hpp>
+#include <unifex/linux/io_uring_pool.hpp>
+#include <unifex/scheduler_concepts.hpp>
+#include <unifex/sync_wait.hpp>
+#include <unifex/then.hpp>
+#include <unifex/when_all.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+using namespace unifex;
+using namespace unifex::linuxos;
+
+static constexpr unsigned char data[6] = {'h', 'e', 'l', 'l', 'o', '\n'};
+
+int main() {
+  io_uring_pool::options opts;
+  opts.ringCount = 4;
+  io_uring_pool pool{opts};
+  auto scheduler = pool.get_scheduler();
+
+  try {
+    {
+      // Work scheduled from one of the pool's threads stays on its ring.
+      auto sameThread = sync_wait(let_value(schedule(scheduler), [&] {
+        return then(
+            schedule(scheduler),
+            [id = std::this_thread::get_id()] {
+              return id == std::this_thread::get_id();
+            });
+      }));
+      std::printf(
+          "rescheduled on the %s thread\n",
+          sameThread.value_or(false) ? "same" : "another");
+    }
+
+    {
+      // Hand work over from the thread of one ring to another.
+      constexpr int hopCount = 1000;
+      int hops = 0;
+      for (int i = 0; i < hopCount; ++i) {
+        auto from = pool.get_scheduler(i % pool.size());
+        auto to = pool.get_scheduler((i + 1) % pool.size());
+        sync_wait(let_value(schedule(from), [&hops, to] {
+          return then(schedule(to), [&hops] { ++hops; });
+        }));
+      }
+      std::printf("handed work between rings %i times\n", hops);
+    }
+
+    {
+      // The other ring is woken straight away, not once the thread that
+      // handed it the work next gets round to submitting.
+      std::atomic<bool> ran = false;
+      bool ranWhileBlocked = false;
+      sync_wait(let_value(schedule(pool.get_scheduler(0)), [&] {
+        return let_value(
+            when_all(
+                then(schedule(pool.get_scheduler(1)), [&] { ran = true; }),
+                then(just(), [&] {
+                  const auto giveUp = std::chrono::steady_clock::now() +
+                      std::chrono::seconds(5);
+                  while (!ran.load() &&
+                         std::chrono::steady_clock::now() < giveUp) {
+                    std::this_thread::yield();
+                  }
+                  ranWhileBlocked = ran.load();
+                })),
+            [](auto&&...) { return just(); });
+      }));
+      std::printf(
+          "other ring %s while this one was blocked\n",
+          ranWhileBlocked ? "ran work" : "did not run work");
+    }
+
+    {
+      // Files opened through the pool's scheduler belong to one of its rings.
+      auto file = open_file_read_write(scheduler, "test_pool.txt");
+      char buffer[sizeof(data)] = {};
+      sync_wait(async_write_some_at(file, 0, as_bytes(span{data})));
+      auto bytesRead = sync_wait(
+          async_read_some_at(file, 0, as_writable_bytes(span{buffer})));
+      std::printf("read %zi bytes through the pool\n", bytesRead.value_or(0));
+    }
+  } catch (const std::exception& ex) {
+    std::printf("error: %s\n", ex.what());
+  }
+
+  return 0;
+}
+
+#else // UNIFEX_NO_LIBURING
+
+#include <cstdio>
+int main() {
+  printf("liburing support not found\n");
+  return 0;
+}
+
+#endif // UNIFEX_NO_LIBURING
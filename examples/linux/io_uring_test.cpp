@@ -18,13 +18,17 @@
 
 #if !UNIFEX_NO_LIBURING
 
+#include <unifex/for_each.hpp>
 #include <unifex/inplace_stop_token.hpp>
 #include <unifex/just.hpp>
+#include <unifex/let_value.hpp>
 #include <unifex/let_value_with.hpp>
 #include <unifex/linux/io_uring_context.hpp>
 #include <unifex/scheduler_concepts.hpp>
 #include <unifex/scope_guard.hpp>
+#include <unifex/sendfile.hpp>
 #include <unifex/sequence.hpp>
+#include <unifex/stop_when.hpp>
 #include <unifex/sync_wait.hpp>
 #include <unifex/then.hpp>
 #include <unifex/when_all.hpp>
@@ -33,10 +37,16 @@
 
 #include <chrono>
 #include <cstdio>
+#include <cstring>
 #include <string>
 #include <thread>
 #include <vector>
 
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
 using namespace unifex;
 using namespace unifex::linuxos;
 using namespace std::chrono_literals;
@@ -93,6 +103,41 @@ auto read_file(io_uring_context::scheduler s, const char* path) {
       });
 }
 
+// Writes and reads back the file through buffers from a registered pool,
+// which are submitted as IORING_OP_WRITE_FIXED/READ_FIXED. If the context
+// has a registered file table the file is also accessed by its slot.
+auto copy_with_registered_buffers(
+    io_uring_context::scheduler s,
+    io_uring_context::registered_buffer_pool& pool,
+    const char* path) {
+  return let_value_with(
+      [s, path]() { return open_file_read_write(s, path); },
+      [&pool](auto& file) {
+        auto buffer = pool.allocate();
+        std::memcpy(buffer.data(), data, sizeof(data));
+        return then(
+            sequence(
+                discard_value(async_write_some_at(
+                    file,
+                    0,
+                    span<const std::byte>{buffer.data(), sizeof(data)})),
+                async_read_some_at(
+                    file, 0, span{buffer.data() + sizeof(data), sizeof(data)})),
+            [&pool, buffer](ssize_t bytesRead) {
+              const bool match =
+                  std::memcmp(
+                      buffer.data(),
+                      buffer.data() + sizeof(data),
+                      sizeof(data)) == 0;
+              std::printf(
+                  "read %zi bytes using registered buffers: %s\n",
+                  bytesRead,
+                  match ? "match" : "mismatch");
+              pool.deallocate(buffer);
+            });
+      });
+}
+
 int main() {
   io_uring_context ctx;
 
@@ -146,6 +191,257 @@ int main() {
         when_all(
             read_file(scheduler, "test.txt"),
             read_file(scheduler, "test.txt"))));
+
+    io_uring_context::registered_buffer_pool pool{ctx, 4096, 4};
+    ctx.register_files(16);
+    scope_guard unregisterFiles = [&]() noexcept { ctx.unregister_files(); };
+    sync_wait(copy_with_registered_buffers(scheduler, pool, "test_fixed.txt"));
+
+    {
+      // Write and read back the file with a single submission.
+      auto file = open_file_read_write(scheduler, "test_link.txt");
+      char buffer[sizeof(data)] = {};
+      auto result = sync_wait(io_uring_context::link(
+          async_write_some_at(file, 0, as_bytes(span{data})),
+          async_read_some_at(file, 0, as_writable_bytes(span{buffer}))));
+      auto [bytesWritten, bytesRead] = *result;
+      std::printf(
+          "linked write of %zi bytes and read of %zi bytes\n",
+          bytesWritten,
+          bytesRead);
+    }
+
+    {
+      // Open, extend, sync, inspect and close a file without blocking the
+      // calling thread on any of the system calls.
+      auto file = std::move(*sync_wait(
+          async_open_file_read_write(scheduler, "test_fallocate.txt")));
+      sync_wait(sequence(
+          async_fallocate(file, 0, std::int64_t{0}, std::int64_t{4096}),
+          async_fdatasync(file)));
+      auto attributes = *sync_wait(async_statx(file, STATX_SIZE));
+      sync_wait(async_close(file));
+      std::printf(
+          "allocated file of %llu bytes\n",
+          static_cast<unsigned long long>(attributes.stx_size));
+    }
+
+    {
+      // A read that never completes is cancelled when the timer fires.
+      int fds[2];
+      if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+        throw std::system_error{errno, std::system_category()};
+      }
+      io_uring_context::async_socket writer{ctx, fds[0]};
+      io_uring_context::async_socket reader{ctx, fds[1]};
+      char buffer[16];
+      auto result = sync_wait(stop_when(
+          async_read_some(reader, as_writable_bytes(span{buffer})),
+          schedule_at(scheduler, now(scheduler) + 100ms)));
+      std::printf("read %s\n", result.has_value() ? "completed" : "cancelled");
+
+      // The kernel cancels the read itself once the linked timeout expires.
+      try {
+        sync_wait(async_read_some(reader, as_writable_bytes(span{buffer}))
+                      .with_timeout(100ms));
+        std::printf("read completed\n");
+      } catch (const std::system_error& ex) {
+        std::printf("read failed: %s\n", ex.code().message().c_str());
+      }
+    }
+
+    {
+      // Receive into buffers that the kernel picks from a shared ring only
+      // once data has arrived, until the peer shuts down its end.
+      int fds[2];
+      if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+        throw std::system_error{errno, std::system_category()};
+      }
+      io_uring_context::async_socket writer{ctx, fds[0]};
+      io_uring_context::async_socket reader{ctx, fds[1]};
+      io_uring_context::provided_buffer_ring buffers{ctx, 4096, 8};
+      sync_wait(async_write_some(writer, as_bytes(span{data})));
+      ::shutdown(writer.native_handle(), SHUT_WR);
+      std::size_t bytesReceived = 0;
+      sync_wait(for_each(
+          recv_stream(reader, buffers),
+          [&](io_uring_context::provided_buffer_ring::lease buffer) {
+            bytesReceived += buffer.data().size();
+          }));
+      std::printf("received %zu bytes from the stream\n", bytesReceived);
+    }
+
+    {
+      // Accept several connections with a single multishot request.
+      auto listener = open_socket(scheduler, AF_INET, SOCK_STREAM);
+      sockaddr_in address{};
+      address.sin_family = AF_INET;
+      address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      socklen_t addressLength = sizeof(address);
+      if (::bind(
+              listener.native_handle(),
+              reinterpret_cast<const sockaddr*>(&address),
+              sizeof(address)) < 0 ||
+          ::listen(listener.native_handle(), 8) < 0 ||
+          ::getsockname(
+              listener.native_handle(),
+              reinterpret_cast<sockaddr*>(&address),
+              &addressLength) < 0) {
+        throw std::system_error{errno, std::system_category()};
+      }
+
+      std::vector<io_uring_context::async_socket> clients;
+      for (int i = 0; i < 3; ++i) {
+        clients.push_back(open_socket(scheduler, AF_INET, SOCK_STREAM));
+        sync_wait(async_connect(
+            clients.back(),
+            reinterpret_cast<const sockaddr*>(&address),
+            addressLength));
+      }
+
+      auto connections = accept_stream(listener);
+      int acceptedCount = 0;
+      for (int i = 0; i < 3; ++i) {
+        if (sync_wait(next(connections)).has_value()) {
+          ++acceptedCount;
+        }
+      }
+      sync_wait(cleanup(connections));
+      std::printf("accepted %i connections from the stream\n", acceptedCount);
+    }
+
+    {
+      // Send a file over a socket, and duplicate its contents into a second
+      // pipe, without copying them through user space.
+      auto file = open_file_read_write(scheduler, "test_splice.txt");
+      sync_wait(async_write_some_at(file, 0, as_bytes(span{data})));
+      int fds[2];
+      if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+        throw std::system_error{errno, std::system_category()};
+      }
+      io_uring_context::async_socket writer{ctx, fds[0]};
+      io_uring_context::async_socket reader{ctx, fds[1]};
+      auto bytesSent =
+          *sync_wait(async_sendfile(scheduler, file, 0, sizeof(data), writer));
+      char buffer[sizeof(data)];
+      auto bytesReceived =
+          *sync_wait(async_read_some(reader, as_writable_bytes(span{buffer})));
+      std::printf(
+          "sent %zu bytes of the file, received %zi\n",
+          bytesSent,
+          bytesReceived);
+
+      auto first = open_pipe(scheduler);
+      auto second = open_pipe(scheduler);
+      sync_wait(async_splice(file, 0, first.second, -1, sizeof(data)));
+      auto bytesCopied =
+          *sync_wait(async_tee(first.first, second.second, sizeof(data)));
+      std::printf("duplicated %zi bytes into a second pipe\n", bytesCopied);
+    }
+
+    {
+      // Write a header and a payload, then read them back into six separate
+      // buffers, with one request each.
+      auto file = open_file_read_write(scheduler, "test_vectored.txt");
+      const char header[] = "size=6\n";
+      const span<const std::byte> outputs[] = {
+          as_bytes(span{header, sizeof(header) - 1}), as_bytes(span{data})};
+      auto bytesWritten =
+          *sync_wait(async_write_some_at(file, 0, span{outputs}));
+      char chunks[6][3] = {};
+      span<std::byte> inputs[6];
+      for (int i = 0; i < 6; ++i) {
+        inputs[i] = as_writable_bytes(span{chunks[i]});
+      }
+      auto bytesRead = *sync_wait(async_read_some_at(file, 0, span{inputs}));
+      std::printf(
+          "wrote %zi bytes from 2 buffers, read %zi bytes into 6\n",
+          bytesWritten,
+          bytesRead);
+    }
+
+    {
+      // A context that never has more than four requests in flight, one of
+      // which is its own wakeup poll. The other reads wait for room.
+      io_uring_context::options limitedOptions;
+      limitedOptions.maxInFlight = 4;
+      io_uring_context limited{limitedOptions};
+      inplace_stop_source limitedStopSource;
+      std::thread limitedThread{
+          [&] { limited.run(limitedStopSource.get_token()); }};
+      scope_guard stopLimited = [&]() noexcept {
+        limitedStopSource.request_stop();
+        limitedThread.join();
+      };
+
+      // Each read waits for a byte to be written to the pipe, so only the
+      // first ones fit.
+      auto limitedScheduler = limited.get_scheduler();
+      auto [reader, writer] = open_pipe(limitedScheduler);
+      char bytes[7] = {};
+      auto read = [&reader = reader, &bytes](int i) {
+        return async_read_some(reader, as_writable_bytes(span{&bytes[i], 1}));
+      };
+      std::thread producer{[&writer = writer] {
+        std::this_thread::sleep_for(100ms);
+        (void)::write(writer.native_handle(), data, sizeof(data));
+      }};
+      sync_wait(when_all(read(0), read(1), read(2), read(3), read(4), read(5)));
+      producer.join();
+
+      // Only start the next read once the context has room for it.
+      (void)::write(writer.native_handle(), data, 1);
+      sync_wait(let_value(limitedScheduler.wait_for_capacity(), [&] {
+        return read(0);
+      }));
+
+      auto stats = limited.get_statistics();
+      std::printf(
+          "limited context: read %zu bytes, %s deferred\n",
+          std::strlen(bytes),
+          stats.deferred > 0 ? "some reads" : "nothing");
+    }
+
+    try {
+      // Bypass the page cache, with buffers that satisfy the alignment
+      // that direct I/O on the file requires.
+      auto file = open_file_read_write(
+          scheduler, "test_direct.txt", open_file_options{true});
+      io_uring_context::aligned_buffer_pool buffers{
+          4096, 1, file.direct_io_alignment()};
+      auto buffer = buffers.allocate();
+      scope_guard deallocate = [&]() noexcept { buffers.deallocate(buffer); };
+      std::memcpy(buffer.data(), data, sizeof(data));
+      auto bytesWritten =
+          *sync_wait(async_write_some_at(file, 0, as_bytes(buffer)));
+      std::printf("wrote %zi bytes with direct I/O\n", bytesWritten);
+
+      // A misaligned read is rejected without being submitted.
+      try {
+        sync_wait(async_read_some_at(
+            file, 0, span{buffer.data() + 1, buffer.size() - 1}));
+        std::printf("misaligned read completed\n");
+      } catch (const std::system_error& ex) {
+        std::printf(
+            "misaligned read failed: %s\n", ex.code().message().c_str());
+      }
+
+      // As is a chain containing one, before any of its requests run.
+      try {
+        sync_wait(io_uring_context::link(
+            async_write_some_at(file, 0, as_bytes(buffer)),
+            async_read_some_at(
+                file, 0, span{buffer.data() + 1, buffer.size() - 1})));
+        std::printf("misaligned linked read completed\n");
+      } catch (const std::system_error& ex) {
+        std::printf(
+            "misaligned linked read failed: %s\n",
+            ex.code().message().c_str());
+      }
+    } catch (const std::system_error& ex) {
+      // Not every file system supports O_DIRECT.
+      std::printf("direct I/O failed: %s\n", ex.code().message().c_str());
+    }
   } catch (const std::exception& ex) {
     std::printf("error: %s\n", ex.what());
   }
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unifex/repeat_effect_until.hpp>
+#include <unifex/scheduler_concepts.hpp>
+#include <unifex/static_thread_pool.hpp>
+#include <unifex/sync_wait.hpp>
+#include <unifex/then.hpp>
+#include <unifex/when_all.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <utility>
+
+using namespace unifex;
+
+// Measures the throughput of tiny continuations that are rescheduled onto
+// the pool from the pool's own threads.
+//
+// Each chain is a loop that schedules a trivial task onto the pool and, on
+// completion, schedules the next one. Chains run concurrently so that every
+// worker has work available and idle workers have something to steal.
+
+namespace {
+constexpr int chainCount = 16;
+constexpr int hopsPerChain = 20'000;
+
+template <typename Scheduler>
+auto chain(Scheduler s, std::atomic<int>& counter) {
+  return repeat_effect_until(
+      then(schedule(s), [&] { counter.fetch_add(1, std::memory_order_relaxed); }),
+      [n = 0]() mutable { return ++n == hopsPerChain; });
+}
+
+template <typename Scheduler, std::size_t... Is>
+auto all_chains(Scheduler s, std::atomic<int>& counter, std::index_sequence<Is...>) {
+  return when_all(((void)Is, chain(s, counter))...);
+}
+
+void run_benchmark(const char* name, const static_thread_pool_options& opts) {
+  static_thread_pool pool{opts};
+  std::atomic<int> counter = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  sync_wait(all_chains(
+      pool.get_scheduler(),
+      counter,
+      std::make_index_sequence<chainCount>{}));
+  auto end = std::chrono::steady_clock::now();
+
+  UNIFEX_ASSERT(counter.load() == chainCount * hopsPerChain);
+
+  const auto us =
+      std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+  std::printf(
+      "%-16s %8d tasks in %8lld us (%.2f Mtasks/s)\n",
+      name,
+      counter.load(),
+      static_cast<long long>(us),
+      us > 0 ? static_cast<double>(counter.load()) / us : 0.0);
+
+  if constexpr (static_thread_pool::stats_enabled) {
+    std::uint64_t stolen = 0;
+    std::uint64_t contention = 0;
+    for (auto& worker : pool.stats().workers) {
+      stolen += worker.tasksStolen;
+      contention += worker.popContention + worker.pushContention;
+    }
+    std::printf(
+        "%-16s %8llu stolen, %8llu failed try_lock\n",
+        "",
+        static_cast<unsigned long long>(stolen),
+        static_cast<unsigned long long>(contention));
+  }
+}
+} // namespace
+
+int main() {
+  static_thread_pool_options shared;
+  run_benchmark("shared-queues", shared);
+
+  static_thread_pool_options runNext;
+  runNext.runNext = true;
+  run_benchmark("run-next", runNext);
+
+  static_thread_pool_options stealing;
+  stealing.workStealing = true;
+  run_benchmark("work-stealing", stealing);
+
+  stealing.runNext = true;
+  run_benchmark("ws+run-next", stealing);
+
+  return 0;
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <unifex/idle_strategy.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#if !defined(__linux__)
+#include <condition_variable>
+#include <mutex>
+#endif
+
+#include <unifex/detail/prologue.hpp>
+
+namespace unifex {
+
+// A condition-variable-like primitive for threads that wait for some
+// condition guarded by other means (eg. a queue protected by a mutex).
+//
+// A waiter calls prepare_wait(), re-checks its condition and then either
+// calls cancel_wait() if the condition is satisfied or wait() with the key
+// returned by prepare_wait(). A notifier makes the condition true and then
+// calls notify_one() or notify_all(). A notification that happens after
+// prepare_wait() is never lost.
+//
+// Waiting follows an idle_strategy: spin, then yield, then block in the
+// kernel. Notifying is a single load when there are no waiters and only
+// makes a system call if a waiter is actually blocked in the kernel.
+class event_count {
+ public:
+  using clock_t = std::chrono::steady_clock;
+  using key = std::uint32_t;
+
+  event_count() noexcept = default;
+
+  event_count(const event_count&) = delete;
+  event_count& operator=(const event_count&) = delete;
+
+  [[nodiscard]] key prepare_wait() noexcept {
+    waiters_.fetch_add(1, std::memory_order_seq_cst);
+    return epoch_.load(std::memory_order_seq_cst);
+  }
+
+  void cancel_wait() noexcept {
+    waiters_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  // Wait until notified after the call to prepare_wait() that returned
+  // 'k'. May return spuriously.
+  void wait(key k, const idle_strategy& idle) noexcept {
+    wait_until(k, idle, clock_t::time_point::max());
+  }
+
+  // As wait(), but also returns once 'deadline' has passed.
+  void wait_until(
+      key k,
+      const idle_strategy& idle,
+      clock_t::time_point deadline) noexcept;
+
+  void notify_one() noexcept {
+    if (waiters_.load(std::memory_order_seq_cst) != 0) {
+      notify_slow(false);
+    }
+  }
+
+  void notify_all() noexcept {
+    if (waiters_.load(std::memory_order_seq_cst) != 0) {
+      notify_slow(true);
+    }
+  }
+
+ private:
+  void notify_slow(bool all) noexcept;
+  void park(key k, clock_t::time_point deadline) noexcept;
+
+  // Incremented by each notification while there are waiters. This is the
+  // futex word on Linux.
+  std::atomic<std::uint32_t> epoch_{0};
+  // Number of threads between prepare_wait() and the end of wait().
+  std::atomic<std::uint32_t> waiters_{0};
+  // Number of threads (about to be) blocked in the kernel.
+  std::atomic<std::uint32_t> parked_{0};
+#if !defined(__linux__)
+  std::mutex mutex_;
+  std::condition_variable cv_;
+#endif
+};
+
+} // namespace unifex
+
+#include <unifex/detail/epilogue.hpp>
@@ -25,7 +25,7 @@ namespace unifex {
 template <typename T, T* T::*Next, T* T::*Prev, typename Key, Key T::*SortKey>
 class intrusive_heap {
  public:
-  intrusive_heap() noexcept : head_(nullptr) {}
+  intrusive_heap() noexcept : head_(nullptr), tail_(nullptr) {}
 
   ~intrusive_heap() {
     T* item = head_;
@@ -57,6 +57,8 @@ class intrusive_heap {
     head_ = item->*Next;
     if (head_ != nullptr) {
       head_->*Prev = nullptr;
+    } else {
+      tail_ = nullptr;
     }
     return item;
   }
@@ -64,9 +66,14 @@ class intrusive_heap {
   void insert(T* item) noexcept {
     // Simple insertion sort to insert item in the right place in the list
     // to keep the list sorted by 'item->*SortKey'.
+    //
+    // Search backwards from the tail as new items (eg. timeouts of the
+    // same duration) usually sort after the items already in the list,
+    // making the common case O(1).
     // TODO: Replace this with a non-toy data-structure.
     if (head_ == nullptr) {
       head_ = item;
+      tail_ = item;
       item->*Next = nullptr;
       item->*Prev = nullptr;
     } else if (item->*SortKey < head_->*SortKey) {
@@ -75,10 +82,9 @@ class intrusive_heap {
       head_->*Prev = item;
       head_ = item;
     } else {
-      auto* insertAfter = head_;
-      while (insertAfter->*Next != nullptr &&
-             insertAfter->*Next->*SortKey <= item->*SortKey) {
-        insertAfter = insertAfter->*Next;
+      auto* insertAfter = tail_;
+      while (item->*SortKey < insertAfter->*SortKey) {
+        insertAfter = insertAfter->*Prev;
       }
 
       auto* insertBefore = insertAfter->*Next;
@@ -88,6 +94,8 @@ class intrusive_heap {
       insertAfter->*Next = item;
       if (insertBefore != nullptr) {
         insertBefore->*Prev = item;
+      } else {
+        tail_ = item;
       }
     }
   }
@@ -103,11 +111,15 @@ class intrusive_heap {
     }
     if (next != nullptr) {
       next->*Prev = prev;
+    } else {
+      UNIFEX_ASSERT(tail_ == item);
+      tail_ = prev;
     }
   }
 
  private:
   T* head_;
+  T* tail_;
 };
 
 } // namespace unifex
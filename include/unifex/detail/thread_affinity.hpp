@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include <unifex/detail/prologue.hpp>
+
+namespace unifex {
+namespace _thread_affinity {
+
+// The CPUs that the calling process may run on, in ascending order. Empty
+// if that is unknown, which is always the case outside Linux.
+std::vector<std::uint32_t> allowed_cpus();
+
+// Pin 'thread' to the given CPUs. Throws std::system_error if a CPU is out
+// of range or the thread can't be pinned. Pinning is only supported on
+// Linux, elsewhere this does nothing.
+void set_thread_affinity(
+    std::thread& thread, const std::vector<std::uint32_t>& cpus);
+
+} // namespace _thread_affinity
+} // namespace unifex
+
+#include <unifex/detail/epilogue.hpp>
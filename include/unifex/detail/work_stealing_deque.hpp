@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include <unifex/detail/prologue.hpp>
+
+namespace unifex {
+
+// A bounded, lock-free work-stealing deque of pointers.
+//
+// This is the fixed-capacity variant of the Chase-Lev deque described in
+// "Correct and Efficient Work-Stealing for Weak Memory Models"
+// (Lê, Pop, Cohen, Zappa Nardelli - PPoPP 2013).
+//
+// A single owner thread pushes and pops items at the 'bottom' end of the
+// deque (LIFO order) while any number of other threads may concurrently
+// steal items from the 'top' end (FIFO order).
+//
+// The capacity is fixed so that no memory reclamation scheme is needed.
+// When the deque is full try_push() fails and the caller is expected to
+// fall back to some other (typically lock-based) queue.
+template <typename Item, std::size_t Capacity = 256>
+class work_stealing_deque {
+  static_assert(
+      Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+      "Capacity must be a power of two");
+
+ public:
+  work_stealing_deque() noexcept = default;
+
+  work_stealing_deque(const work_stealing_deque&) = delete;
+  work_stealing_deque(work_stealing_deque&&) = delete;
+  work_stealing_deque& operator=(const work_stealing_deque&) = delete;
+  work_stealing_deque& operator=(work_stealing_deque&&) = delete;
+
+  ~work_stealing_deque() {
+    UNIFEX_ASSERT(empty());
+  }
+
+  // Push an item onto the bottom of the deque.
+  // Returns false if the deque is full.
+  //
+  // Must only be called by the owning thread.
+  [[nodiscard]] bool try_push(Item* item) noexcept {
+    const std::int64_t b = bottom_.load(std::memory_order_relaxed);
+    const std::int64_t t = top_.load(std::memory_order_acquire);
+    if (b - t >= static_cast<std::int64_t>(Capacity)) {
+      return false;
+    }
+    buffer_[b & mask].store(item, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom_.store(b + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // Pop the most recently pushed item from the bottom of the deque.
+  // Returns nullptr if the deque is empty (or if the last item was
+  // concurrently stolen).
+  //
+  // Must only be called by the owning thread.
+  [[nodiscard]] Item* pop() noexcept {
+    const std::int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+    bottom_.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::int64_t t = top_.load(std::memory_order_relaxed);
+
+    if (t > b) {
+      // Deque was empty.
+      bottom_.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+
+    Item* item = buffer_[b & mask].load(std::memory_order_relaxed);
+    if (t == b) {
+      // Taking the last item. Race with any thieves for it.
+      if (!top_.compare_exchange_strong(
+              t,
+              t + 1,
+              std::memory_order_seq_cst,
+              std::memory_order_relaxed)) {
+        item = nullptr;
+      }
+      bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+    return item;
+  }
+
+  // Steal the least recently pushed item from the top of the deque.
+  // Returns nullptr if the deque is empty or if this thread lost a race
+  // with the owner or another thief.
+  //
+  // May be called by any thread.
+  [[nodiscard]] Item* steal() noexcept {
+    std::int64_t t = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const std::int64_t b = bottom_.load(std::memory_order_acquire);
+    if (t >= b) {
+      return nullptr;
+    }
+
+    Item* item = buffer_[t & mask].load(std::memory_order_relaxed);
+    if (!top_.compare_exchange_strong(
+            t,
+            t + 1,
+            std::memory_order_seq_cst,
+            std::memory_order_relaxed)) {
+      return nullptr;
+    }
+    return item;
+  }
+
+  // A snapshot of whether the deque contains any items.
+  // May be stale by the time the caller looks at the result.
+  [[nodiscard]] bool empty() const noexcept {
+    const std::int64_t t = top_.load(std::memory_order_relaxed);
+    const std::int64_t b = bottom_.load(std::memory_order_relaxed);
+    return b <= t;
+  }
+
+  // A snapshot of the number of items in the deque.
+  [[nodiscard]] std::size_t size() const noexcept {
+    const std::int64_t t = top_.load(std::memory_order_relaxed);
+    const std::int64_t b = bottom_.load(std::memory_order_relaxed);
+    return b > t ? static_cast<std::size_t>(b - t) : 0;
+  }
+
+ private:
+  static constexpr std::int64_t mask = static_cast<std::int64_t>(Capacity) - 1;
+
+  // 'top_' is written by thieves, 'bottom_' only by the owner.
+  // Keep them on separate cache-lines to avoid false-sharing.
+  alignas(64) std::atomic<std::int64_t> top_{0};
+  alignas(64) std::atomic<std::int64_t> bottom_{0};
+  alignas(64) std::atomic<Item*> buffer_[Capacity] = {};
+};
+
+} // namespace unifex
+
+#include <unifex/detail/epilogue.hpp>
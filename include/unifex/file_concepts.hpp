@@ -25,6 +25,14 @@
 
 namespace unifex {
 namespace _filesystem {
+// Options that may be passed to the open_file_* and async_open_file_* CPOs.
+struct open_file_options {
+  // Open the file for direct I/O (O_DIRECT), bypassing the page cache. The
+  // buffers, offsets and lengths of reads and writes must then be aligned
+  // to the file's direct I/O alignment.
+  bool direct = false;
+};
+
 inline const struct open_file_read_only_cpo {
   template <typename Executor>
   auto operator()(Executor&& executor, const filesystem::path& path) const
@@ -38,6 +46,24 @@ inline const struct open_file_read_only_cpo {
               const filesystem::path&> {
     return unifex::tag_invoke(*this, (Executor &&) executor, path);
   }
+
+  template <typename Executor>
+  auto operator()(
+      Executor&& executor,
+      const filesystem::path& path,
+      const open_file_options& options) const
+      noexcept(is_nothrow_tag_invocable_v<
+               open_file_read_only_cpo,
+               Executor,
+               const filesystem::path&,
+               const open_file_options&>)
+          -> tag_invoke_result_t<
+              open_file_read_only_cpo,
+              Executor,
+              const filesystem::path&,
+              const open_file_options&> {
+    return unifex::tag_invoke(*this, (Executor &&) executor, path, options);
+  }
 } open_file_read_only{};
 
 inline const struct open_file_write_only_cpo {
@@ -53,6 +79,24 @@ inline const struct open_file_write_only_cpo {
               const filesystem::path&> {
     return unifex::tag_invoke(*this, (Executor &&) executor, path);
   }
+
+  template <typename Executor>
+  auto operator()(
+      Executor&& executor,
+      const filesystem::path& path,
+      const open_file_options& options) const
+      noexcept(is_nothrow_tag_invocable_v<
+               open_file_write_only_cpo,
+               Executor,
+               const filesystem::path&,
+               const open_file_options&>)
+          -> tag_invoke_result_t<
+              open_file_write_only_cpo,
+              Executor,
+              const filesystem::path&,
+              const open_file_options&> {
+    return unifex::tag_invoke(*this, (Executor &&) executor, path, options);
+  }
 } open_file_write_only{};
 
 inline const struct open_file_read_write_cpo {
@@ -68,12 +112,213 @@ inline const struct open_file_read_write_cpo {
               const filesystem::path&> {
     return unifex::tag_invoke(*this, (Executor &&) executor, path);
   }
+
+  template <typename Executor>
+  auto operator()(
+      Executor&& executor,
+      const filesystem::path& path,
+      const open_file_options& options) const
+      noexcept(is_nothrow_tag_invocable_v<
+               open_file_read_write_cpo,
+               Executor,
+               const filesystem::path&,
+               const open_file_options&>)
+          -> tag_invoke_result_t<
+              open_file_read_write_cpo,
+              Executor,
+              const filesystem::path&,
+              const open_file_options&> {
+    return unifex::tag_invoke(*this, (Executor &&) executor, path, options);
+  }
 } open_file_read_write{};
+
+// async_open_file_read_only(executor, path) and friends
+//
+// Asynchronous counterparts of the open_file_* CPOs that return a sender
+// producing the opened file rather than opening it on the calling thread.
+inline const struct async_open_file_read_only_cpo {
+  template <typename Executor>
+  auto operator()(Executor&& executor, const filesystem::path& path) const
+      noexcept(is_nothrow_tag_invocable_v<
+               async_open_file_read_only_cpo,
+               Executor,
+               const filesystem::path&>)
+          -> tag_invoke_result_t<
+              async_open_file_read_only_cpo,
+              Executor,
+              const filesystem::path&> {
+    return unifex::tag_invoke(*this, (Executor &&) executor, path);
+  }
+
+  template <typename Executor>
+  auto operator()(
+      Executor&& executor,
+      const filesystem::path& path,
+      const open_file_options& options) const
+      noexcept(is_nothrow_tag_invocable_v<
+               async_open_file_read_only_cpo,
+               Executor,
+               const filesystem::path&,
+               const open_file_options&>)
+          -> tag_invoke_result_t<
+              async_open_file_read_only_cpo,
+              Executor,
+              const filesystem::path&,
+              const open_file_options&> {
+    return unifex::tag_invoke(*this, (Executor &&) executor, path, options);
+  }
+} async_open_file_read_only{};
+
+inline const struct async_open_file_write_only_cpo {
+  template <typename Executor>
+  auto operator()(Executor&& executor, const filesystem::path& path) const
+      noexcept(is_nothrow_tag_invocable_v<
+               async_open_file_write_only_cpo,
+               Executor,
+               const filesystem::path&>)
+          -> tag_invoke_result_t<
+              async_open_file_write_only_cpo,
+              Executor,
+              const filesystem::path&> {
+    return unifex::tag_invoke(*this, (Executor &&) executor, path);
+  }
+
+  template <typename Executor>
+  auto operator()(
+      Executor&& executor,
+      const filesystem::path& path,
+      const open_file_options& options) const
+      noexcept(is_nothrow_tag_invocable_v<
+               async_open_file_write_only_cpo,
+               Executor,
+               const filesystem::path&,
+               const open_file_options&>)
+          -> tag_invoke_result_t<
+              async_open_file_write_only_cpo,
+              Executor,
+              const filesystem::path&,
+              const open_file_options&> {
+    return unifex::tag_invoke(*this, (Executor &&) executor, path, options);
+  }
+} async_open_file_write_only{};
+
+inline const struct async_open_file_read_write_cpo {
+  template <typename Executor>
+  auto operator()(Executor&& executor, const filesystem::path& path) const
+      noexcept(is_nothrow_tag_invocable_v<
+               async_open_file_read_write_cpo,
+               Executor,
+               const filesystem::path&>)
+          -> tag_invoke_result_t<
+              async_open_file_read_write_cpo,
+              Executor,
+              const filesystem::path&> {
+    return unifex::tag_invoke(*this, (Executor &&) executor, path);
+  }
+
+  template <typename Executor>
+  auto operator()(
+      Executor&& executor,
+      const filesystem::path& path,
+      const open_file_options& options) const
+      noexcept(is_nothrow_tag_invocable_v<
+               async_open_file_read_write_cpo,
+               Executor,
+               const filesystem::path&,
+               const open_file_options&>)
+          -> tag_invoke_result_t<
+              async_open_file_read_write_cpo,
+              Executor,
+              const filesystem::path&,
+              const open_file_options&> {
+    return unifex::tag_invoke(*this, (Executor &&) executor, path, options);
+  }
+} async_open_file_read_write{};
+
+// async_close(file)
+//
+// Returns a sender that closes the file's descriptor. The file object must
+// still be destroyed afterwards but no longer owns a descriptor.
+inline const struct async_close_cpo {
+  template <typename File>
+  auto operator()(File& file) const
+      noexcept(is_nothrow_tag_invocable_v<async_close_cpo, File&>)
+          -> tag_invoke_result_t<async_close_cpo, File&> {
+    return unifex::tag_invoke(*this, file);
+  }
+} async_close{};
+
+// async_fsync(file) / async_fdatasync(file)
+//
+// Returns a sender that flushes the file's data, and for async_fsync() all
+// of its metadata, to the storage device.
+inline const struct async_fsync_cpo {
+  template <typename File>
+  auto operator()(File& file) const
+      noexcept(is_nothrow_tag_invocable_v<async_fsync_cpo, File&>)
+          -> tag_invoke_result_t<async_fsync_cpo, File&> {
+    return unifex::tag_invoke(*this, file);
+  }
+} async_fsync{};
+
+inline const struct async_fdatasync_cpo {
+  template <typename File>
+  auto operator()(File& file) const
+      noexcept(is_nothrow_tag_invocable_v<async_fdatasync_cpo, File&>)
+          -> tag_invoke_result_t<async_fdatasync_cpo, File&> {
+    return unifex::tag_invoke(*this, file);
+  }
+} async_fdatasync{};
+
+// async_fallocate(file, mode, offset, length)
+//
+// Returns a sender that allocates, or with the appropriate mode deallocates,
+// a range of the file as fallocate(2) does.
+inline const struct async_fallocate_cpo {
+  template <typename File, typename Offset>
+  auto operator()(File& file, int mode, Offset offset, Offset length) const
+      noexcept(is_nothrow_tag_invocable_v<
+               async_fallocate_cpo,
+               File&,
+               int,
+               Offset,
+               Offset>)
+          -> tag_invoke_result_t<
+              async_fallocate_cpo,
+              File&,
+              int,
+              Offset,
+              Offset> {
+    return unifex::tag_invoke(*this, file, mode, offset, length);
+  }
+} async_fallocate{};
+
+// async_statx(file, mask)
+//
+// Returns a sender that produces the attributes of the file selected by
+// 'mask', as statx(2) does.
+inline const struct async_statx_cpo {
+  template <typename File>
+  auto operator()(File& file, unsigned int mask) const
+      noexcept(is_nothrow_tag_invocable_v<async_statx_cpo, File&, unsigned int>)
+          -> tag_invoke_result_t<async_statx_cpo, File&, unsigned int> {
+    return unifex::tag_invoke(*this, file, mask);
+  }
+} async_statx{};
 } // namespace _filesystem
 
+using _filesystem::open_file_options;
 using _filesystem::open_file_read_only;
 using _filesystem::open_file_write_only;
 using _filesystem::open_file_read_write;
+using _filesystem::async_open_file_read_only;
+using _filesystem::async_open_file_write_only;
+using _filesystem::async_open_file_read_write;
+using _filesystem::async_close;
+using _filesystem::async_fsync;
+using _filesystem::async_fdatasync;
+using _filesystem::async_fallocate;
+using _filesystem::async_statx;
 } // namespace unifex
 
 #include <unifex/detail/epilogue.hpp>
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cstdint>
+
+#include <unifex/detail/prologue.hpp>
+
+namespace unifex {
+
+// Controls how a thread that has run out of work waits for more.
+//
+// The thread first busy-waits for 'spinCount' iterations, executing a CPU
+// pause instruction on each, then calls std::this_thread::yield() up to
+// 'yieldCount' times and finally blocks in the kernel (on a futex on
+// Linux) until it is woken up.
+//
+// Spinning trades CPU time for wake-up latency: work that arrives while
+// the thread is still spinning or yielding is picked up without a context
+// switch and without the enqueuing thread making a system call.
+struct idle_strategy {
+  std::uint32_t spinCount = 128;
+  std::uint32_t yieldCount = 8;
+
+  // Block straight away, without spinning or yielding.
+  static constexpr idle_strategy block() noexcept {
+    return idle_strategy{0, 0};
+  }
+};
+
+} // namespace unifex
+
+#include <unifex/detail/epilogue.hpp>
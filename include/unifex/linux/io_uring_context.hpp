@@ -20,29 +20,47 @@
 
 #include <unifex/detail/atomic_intrusive_queue.hpp>
 #include <unifex/detail/intrusive_heap.hpp>
+#include <unifex/detail/intrusive_list.hpp>
 #include <unifex/detail/intrusive_queue.hpp>
+#include <unifex/exception.hpp>
 #include <unifex/file_concepts.hpp>
 #include <unifex/filesystem.hpp>
+#include <unifex/get_allocator.hpp>
 #include <unifex/get_stop_token.hpp>
 #include <unifex/manual_lifetime.hpp>
+#include <unifex/pipe_concepts.hpp>
 #include <unifex/receiver_concepts.hpp>
+#include <unifex/socket_concepts.hpp>
 #include <unifex/span.hpp>
 #include <unifex/stop_token_concepts.hpp>
+#include <unifex/stream_concepts.hpp>
+#include <unifex/type_list.hpp>
 
 #include <unifex/linux/mmap_region.hpp>
 #include <unifex/linux/monotonic_clock.hpp>
 #include <unifex/linux/safe_file_descriptor.hpp>
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <climits>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <system_error>
+#include <tuple>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
 #include <liburing/io_uring.h>
 
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/uio.h>
 
 #include <unifex/detail/prologue.hpp>
@@ -54,17 +72,143 @@ class io_uring_context {
  public:
   class schedule_sender;
   class schedule_at_sender;
+  class capacity_sender;
   template <typename Duration>
   class schedule_after_sender;
-  class read_sender;
-  class write_sender;
   class async_read_only_file;
   class async_read_write_file;
   class async_write_only_file;
+  class async_socket;
+  class async_reader;
+  class async_writer;
+  class aligned_buffer_pool;
+  class registered_buffer_pool;
+  class provided_buffer_ring;
   class scheduler;
 
+  // A sender of a single io_uring operation, described by 'IoOp'.
+  template <typename IoOp>
+  class io_sender;
+
+  // A sender of a chain of io_uring operations submitted together.
+  template <typename... IoOps>
+  class link_sender;
+
+  // A stream of the completions of a multishot io_uring operation, described
+  // by 'MultishotOp'.
+  template <typename MultishotOp>
+  class multishot_stream;
+
+ private:
+  struct read_op;
+  struct write_op;
+  template <typename Byte>
+  struct vectored_op;
+  struct recv_op;
+  struct send_op;
+  struct recv_msg_op;
+  struct send_msg_op;
+  struct accept_op;
+  struct connect_op;
+  template <typename File>
+  struct open_op;
+  struct close_op;
+  struct fsync_op;
+  struct fallocate_op;
+  struct statx_op;
+  struct splice_op;
+  struct tee_op;
+  struct recv_multishot_op;
+  struct accept_multishot_op;
+  class file_base;
+
+ public:
+  using read_sender = io_sender<read_op>;
+  using write_sender = io_sender<write_op>;
+  using readv_sender = io_sender<vectored_op<std::byte>>;
+  using writev_sender = io_sender<vectored_op<const std::byte>>;
+  using recv_sender = io_sender<recv_op>;
+  using send_sender = io_sender<send_op>;
+  using recv_msg_sender = io_sender<recv_msg_op>;
+  using send_msg_sender = io_sender<send_msg_op>;
+  using accept_sender = io_sender<accept_op>;
+  using connect_sender = io_sender<connect_op>;
+  template <typename File>
+  using open_sender = io_sender<open_op<File>>;
+  using close_sender = io_sender<close_op>;
+  using fsync_sender = io_sender<fsync_op>;
+  using fallocate_sender = io_sender<fallocate_op>;
+  using statx_sender = io_sender<statx_op>;
+  using splice_sender = io_sender<splice_op>;
+  using tee_sender = io_sender<tee_op>;
+  using recv_multishot_stream = multishot_stream<recv_multishot_op>;
+  using accept_multishot_stream = multishot_stream<accept_multishot_op>;
+
+  struct options {
+    // Number of submission queue entries. Rounded up to a power of two by
+    // the kernel.
+    std::uint32_t sqEntries = 256;
+
+    // Number of completion queue entries. Zero means the kernel default of
+    // twice the number of submission queue entries.
+    std::uint32_t cqEntries = 0;
+
+    // When true the kernel starts a thread that polls the submission queue
+    // (IORING_SETUP_SQPOLL), so that submitting I/O does not need a system
+    // call while the thread is awake. The thread goes to sleep after
+    // 'sqPollIdle' without submissions (zero means the kernel default) and
+    // is pinned to 'sqPollCpu' unless it is negative.
+    bool sqPoll = false;
+    std::chrono::milliseconds sqPollIdle{0};
+    int sqPollCpu = -1;
+
+    // When true completions are busy-polled from the device rather than
+    // delivered by interrupts (IORING_SETUP_IOPOLL). Only reads and writes of
+    // files opened for direct I/O on a device that supports polling may be
+    // submitted. Since the ring cannot wait on the remote queue or on timers,
+    // the I/O thread busy-polls for those as well.
+    bool ioPoll = false;
+
+    // Maximum number of requests in flight at once. Operations started
+    // beyond that wait inside the context until earlier requests complete.
+    // Zero means the size of the completion queue, less a few entries kept
+    // for the context's own requests for timers and remote wakeups and for
+    // cancellations, which are not held back by the limit. An operation that
+    // needs more requests than the limit allows at once, such as a read with
+    // a timeout when the limit is one, fails with EINVAL.
+    std::uint32_t maxInFlight = 0;
+  };
+
+  // Counters of the context's activity since it was constructed. Only
+  // updated by the I/O thread but may be read from any thread.
+  struct statistics {
+    // Requests submitted to the ring, and completions reaped from it.
+    std::uint64_t submitted = 0;
+    std::uint64_t completed = 0;
+
+    // Times that an operation could not be submitted straight away because
+    // the in-flight limit or the submission queue was reached, and had to
+    // wait.
+    std::uint64_t deferred = 0;
+
+    // Times that completions the kernel held back because the completion
+    // queue was full (IORING_SQ_CQ_OVERFLOW) were flushed into it.
+    std::uint64_t overflowFlushes = 0;
+
+    // Completions that the kernel dropped because the completion queue was
+    // full and it could not hold on to them. The operations that they
+    // belonged to never complete.
+    std::uint64_t droppedCompletions = 0;
+
+    // Times that io_uring_enter() refused to submit (EBUSY or EAGAIN) and was
+    // retried after reaping completions.
+    std::uint64_t busyRetries = 0;
+  };
+
   io_uring_context();
 
+  explicit io_uring_context(const options& opts);
+
   ~io_uring_context();
 
   template <typename StopToken>
@@ -72,10 +216,50 @@ class io_uring_context {
 
   scheduler get_scheduler() noexcept;
 
+  statistics get_statistics() const noexcept;
+
+  // Submit the requests of several io_senders as one IOSQE_IO_LINK chain, so
+  // that each one starts only once the previous one has succeeded. Completes
+  // with the values produced by each of the senders, in order.
+  //
+  // Throws std::system_error (EINVAL) if the chain has more requests than
+  // fit in the submission queue or under the in-flight limit at once.
+  template <typename... IoOps>
+  static link_sender<IoOps...> link(io_sender<IoOps>... senders);
+
+  // Register a set of buffers with the kernel (IORING_REGISTER_BUFFERS) so
+  // that their pages stay pinned for the lifetime of the registration.
+  //
+  // Reads and writes whose buffer lies entirely within one of the registered
+  // buffers are then submitted as IORING_OP_READ_FIXED/WRITE_FIXED.
+  //
+  // Only one set of buffers can be registered at a time. Must not be called
+  // concurrently with the submission of reads or writes on this context.
+  void register_buffers(span<const iovec> buffers);
+
+  // Unregister the buffers passed to register_buffers(). The caller must
+  // ensure that no I/O is outstanding on the registered buffers.
+  void unregister_buffers();
+
+  // Register a sparse table of 'slotCount' files with the kernel
+  // (IORING_REGISTER_FILES).
+  //
+  // Files subsequently opened on this context are installed into a free slot
+  // (IORING_REGISTER_FILES_UPDATE) and their I/O is submitted with
+  // IOSQE_FIXED_FILE, saving the kernel a file reference count round-trip per
+  // operation. Files opened while the table is full use their descriptor.
+  void register_files(std::uint32_t slotCount);
+
+  // Unregister the file table. All files holding a slot must have been
+  // destroyed.
+  void unregister_files();
+
  private:
   struct operation_base {
     operation_base() noexcept {}
     operation_base* next_;
+    // Only used while in the pending I/O queue.
+    operation_base* prev_;
     void (*execute_)(operation_base*) noexcept;
   };
 
@@ -83,6 +267,21 @@ class io_uring_context {
     int result_;
   };
 
+  // A request that posts a completion for each of its results until it
+  // ends. Its user_data is tagged with multishot_user_data_tag and every CQE
+  // is handed to complete_() as soon as it is reaped, since the operation
+  // cannot sit in the local queue more than once.
+  struct multishot_base : operation_base {
+    void (*complete_)(
+        multishot_base*, int result, std::uint32_t flags) noexcept;
+  };
+
+  static constexpr std::uintptr_t multishot_user_data_tag = 1;
+
+  // The tag of the user_data of IORING_OP_MSG_RING requests that wake up
+  // another context, whose address is in the remaining bits.
+  static constexpr std::uintptr_t message_user_data_tag = 2;
+
   struct stop_operation : operation_base {
     stop_operation() noexcept {
       this->execute_ = [](operation_base * op) noexcept {
@@ -117,6 +316,13 @@ class io_uring_context {
   using operation_queue =
       intrusive_queue<operation_base, &operation_base::next_>;
 
+  // Operations can be taken out of the middle, for when they are cancelled
+  // while waiting.
+  using pending_io_queue = intrusive_list<
+      operation_base,
+      &operation_base::next_,
+      &operation_base::prev_>;
+
   using timer_heap = intrusive_heap<
       schedule_at_operation,
       &schedule_at_operation::timerNext_,
@@ -125,6 +331,141 @@ class io_uring_context {
       &schedule_at_operation::dueTime_>;
 
   bool is_running_on_io_thread() const noexcept;
+
+  // Returns the index of the registered buffer that fully contains the range
+  // [data, data + size), or -1 if there is no such buffer.
+  int find_registered_buffer(const void* data, std::size_t size) const noexcept;
+
+  // A slot in the registered file table, released on destruction.
+  class file_slot {
+   public:
+    file_slot() noexcept = default;
+
+    explicit file_slot(io_uring_context& context, int index) noexcept
+      : context_(&context), index_(index) {}
+
+    file_slot(file_slot&& other) noexcept
+      : context_(std::exchange(other.context_, nullptr)),
+        index_(std::exchange(other.index_, -1)) {}
+
+    ~file_slot() {
+      if (context_ != nullptr) {
+        context_->unregister_file(index_);
+      }
+    }
+
+    file_slot& operator=(file_slot other) noexcept {
+      std::swap(context_, other.context_);
+      std::swap(index_, other.index_);
+      return *this;
+    }
+
+    // The index of the slot, or -1 if the file is not registered.
+    int index() const noexcept { return index_; }
+
+   private:
+    io_uring_context* context_ = nullptr;
+    int index_ = -1;
+  };
+
+  // Install 'fd' into a free slot of the registered file table.
+  // Returns an empty slot if there is no table or it is full.
+  file_slot try_register_file(int fd) noexcept;
+  void unregister_file(int index) noexcept;
+
+  // The alignment of the buffers, offsets and lengths of direct I/O on a
+  // file. Both are zero for a file that was not opened for direct I/O.
+  struct dio_alignment {
+    std::uint32_t memory_ = 0;
+    std::uint32_t offset_ = 0;
+
+    bool is_aligned(
+        const void* data, std::int64_t offset, std::size_t length)
+        const noexcept {
+      return memory_ == 0 ||
+          (reinterpret_cast<std::uintptr_t>(data) % memory_ == 0 &&
+           static_cast<std::uint64_t>(offset) % offset_ == 0 &&
+           length % offset_ == 0);
+    }
+  };
+
+  // Queries the kernel for the direct I/O alignment of 'fd' (STATX_DIOALIGN,
+  // or the logical block size of a block device), falling back to the page
+  // size, which satisfies any device.
+  static dio_alignment query_dio_alignment(int fd) noexcept;
+
+  // Calls the optional validate(), prepare() and release() of an IoOp, see
+  // io_sender.
+  template <typename IoOp>
+  static auto validate_io(const IoOp& io, int) noexcept
+      -> decltype(io.validate()) {
+    return io.validate();
+  }
+  template <typename IoOp>
+  static int validate_io(const IoOp&, long) noexcept {
+    return 0;
+  }
+
+  template <typename IoOp, typename Allocator>
+  static auto prepare_io(IoOp& io, const Allocator& allocator, int)
+      -> decltype(io.prepare(allocator)) {
+    io.prepare(allocator);
+  }
+  template <typename IoOp, typename Allocator>
+  static void prepare_io(IoOp&, const Allocator&, long) noexcept {}
+
+  template <typename IoOp, typename Allocator>
+  static auto release_io(IoOp& io, const Allocator& allocator, int) noexcept
+      -> decltype(io.release(allocator)) {
+    io.release(allocator);
+  }
+  template <typename IoOp, typename Allocator>
+  static void release_io(IoOp&, const Allocator&, long) noexcept {}
+
+  // One end of a splice: a file, socket or pipe of this context.
+  struct splice_end {
+    io_uring_context* context_;
+    // An index into the registered file table if 'fixedFile_' is true.
+    int fd_;
+    bool fixedFile_;
+  };
+
+  template <typename Source, typename Destination>
+  static auto splice_(
+      Source& source,
+      std::int64_t sourceOffset,
+      Destination& destination,
+      std::int64_t destinationOffset,
+      std::size_t length) noexcept
+      -> decltype(
+          source.splice_end_(),
+          destination.splice_end_(),
+          UNIFEX_DECLVAL(splice_sender));
+
+  template <typename Source, typename Destination>
+  friend auto tag_invoke(
+      tag_t<async_splice>,
+      Source& source,
+      std::int64_t sourceOffset,
+      Destination& destination,
+      std::int64_t destinationOffset,
+      std::size_t length) noexcept
+      -> decltype(io_uring_context::splice_(
+          source, sourceOffset, destination, destinationOffset, length)) {
+    return io_uring_context::splice_(
+        source, sourceOffset, destination, destinationOffset, length);
+  }
+
+  static tee_sender
+  tee_(async_reader& source, async_writer& destination, std::size_t length)
+      noexcept;
+
+  friend tee_sender tag_invoke(
+      tag_t<async_tee>,
+      async_reader& source,
+      async_writer& destination,
+      std::size_t length) noexcept;
+
   void run_impl(const bool& shouldStop);
 
   void schedule_impl(operation_base* op);
@@ -134,7 +475,16 @@ class io_uring_context {
 
   // Schedule some operation to be run when there is next available I/O slots.
   void schedule_pending_io(operation_base* op) noexcept;
+  // Put an operation that was taken from the pending I/O queue but still
+  // does not fit back at its front, and stop resuming pending operations
+  // until the next pass of the run loop.
   void reschedule_pending_io(operation_base* op) noexcept;
+  // Take an operation that was cancelled out of the pending I/O queue.
+  void remove_pending_io(operation_base* op) noexcept;
+
+  // Schedule a cancellation to be retried once there is space in the
+  // submission queue, whatever the in-flight limit.
+  void schedule_pending_cancel(operation_base* op) noexcept;
 
   // Insert the timer operation into the queue of timers.
   // Must be called from the I/O thread.
@@ -174,6 +524,23 @@ class io_uring_context {
   // inactive.
   void signal_remote_queue();
 
+  // Signal the remote queue by submitting an IORING_OP_MSG_RING to the ring
+  // of the calling thread, if it is the I/O thread of another context.
+  //
+  // The message is submitted to the kernel straight away, as the calling
+  // thread may stop running its context or block before it next submits.
+  //
+  // Returns false if the calling thread does not run a context, either ring
+  // does not support messages, the submission queue is full or the kernel
+  // did not take the message yet, in which case the caller should signal the
+  // eventfd instead.
+  bool try_message_remote_queue() noexcept;
+
+  // Submit the entries added to the submission queue so far, without
+  // waiting for any completions. Returns false if the kernel did not take
+  // all of them.
+  bool flush_submission_queue() noexcept;
+
   void remove_timer(schedule_at_operation* op) noexcept;
   void update_timers() noexcept;
   bool try_submit_timer_io(const time_point& dueTime) noexcept;
@@ -185,6 +552,30 @@ class io_uring_context {
   template <typename PopulateFn>
   bool try_submit_io(PopulateFn populateSqe) noexcept;
 
+  // Try to submit 'count' consecutive entries to the submission queue, as
+  // needed for a chain of IOSQE_IO_LINK'ed requests.
+  //
+  // If there is space for all of them then populateSqe(sqe, index) is called
+  // for each entry in order. Otherwise nothing is submitted.
+  template <typename PopulateFn>
+  bool try_submit_io(std::uint32_t count, PopulateFn populateSqe) noexcept;
+
+  // As try_submit_io() but only limited by the space in the submission
+  // queue, not by the in-flight limit. For the context's own requests and
+  // for cancellations, which are what lets the requests that hold up the
+  // limit complete.
+  template <typename PopulateFn>
+  bool try_submit_unlimited_io(PopulateFn populateSqe) noexcept;
+  template <typename PopulateFn>
+  bool try_submit_unlimited_io(
+      std::uint32_t count, PopulateFn populateSqe) noexcept;
+
+  // Whether an operation that submits 'count' requests at once can ever
+  // get under the in-flight limit.
+  bool fits_in_flight_limit(std::uint32_t count) const noexcept {
+    return count <= inFlightLimit_;
+  }
+
   // Total number of operations submitted that have not yet
   // completed.
   std::uint32_t pending_operation_count() const noexcept {
@@ -192,11 +583,22 @@ class io_uring_context {
   }
 
   // Query whether there is space in the submission ring buffer
-  // and space in the completion ring buffer for an additional
-  // entry.
+  // for an additional entry and room under the in-flight limit.
   bool can_submit_io() const noexcept {
     return sqUnflushedCount_ < sqEntryCount_ &&
-        pending_operation_count() < cqEntryCount_;
+        pending_operation_count() < inFlightLimit_;
+  }
+
+  // Move the completions that the kernel held back because the completion
+  // queue was full into it, and acquire them.
+  void flush_overflowed_completions() noexcept;
+
+  // Counters are only written by the I/O thread, so they need no
+  // read-modify-write.
+  static void increment(
+      std::atomic<std::uint64_t>& counter, std::uint64_t n = 1) noexcept {
+    counter.store(
+        counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
   }
 
   std::uintptr_t timer_user_data() const {
@@ -207,6 +609,12 @@ class io_uring_context {
     return reinterpret_cast<std::uintptr_t>(&currentDueTime_);
   }
 
+  // The user_data of IORING_OP_ASYNC_CANCEL requests, whose completions are
+  // ignored.
+  std::uintptr_t cancel_user_data() const {
+    return reinterpret_cast<std::uintptr_t>(&pendingIoQueue_);
+  }
+
   struct __kernel_timespec {
     int64_t tv_sec;
     long long tv_nsec;
@@ -215,6 +623,19 @@ class io_uring_context {
   ////////
   // Data that does not change once initialised.
 
+  bool sqPoll_;
+  bool ioPoll_;
+  bool msgRingSupported_ = false;
+
+  // The most requests that may be in flight at once, leaving enough of the
+  // completion queue for the unlimited requests (see reserved_cq_entries)
+  // so that completions of single-shot requests do not overflow it.
+  std::uint32_t inFlightLimit_;
+
+  // Completion queue entries kept out of inFlightLimit_ for the remote
+  // queue poll, the active timer and its removal, plus a cancellation.
+  static constexpr std::uint32_t reserved_cq_entries = 4;
+
   // Submission queue state
   std::uint32_t sqEntryCount_;
   std::uint32_t sqMask_;
@@ -240,6 +661,22 @@ class io_uring_context {
   mmap_region sqMmap_;
   mmap_region sqeMmap_;
 
+  // Buffers registered with the kernel, sorted by address.
+  struct registered_buffer {
+    std::uintptr_t begin_;
+    std::uintptr_t end_;
+    int index_;
+  };
+  std::vector<registered_buffer> registeredBuffers_;
+
+  // Free slots of the registered file table.
+  std::mutex fileSlotMutex_;
+  std::vector<int> freeFileSlots_;
+  std::uint32_t fileSlotCount_ = 0;
+
+  // The group id of the next provided_buffer_ring.
+  std::atomic<std::uint16_t> nextBufferGroup_{0};
+
   ///////////////////
   // Data that is modified by I/O thread
 
@@ -247,7 +684,13 @@ class io_uring_context {
   operation_queue localQueue_;
 
   // Operations that are waiting for more space in the I/O queues.
-  operation_queue pendingIoQueue_;
+  pending_io_queue pendingIoQueue_;
+  // Set when the operation at the front of pendingIoQueue_ needs more space
+  // than there is.
+  bool pendingIoStalled_ = false;
+
+  // Cancellations that are waiting for space in the submission queue.
+  operation_queue pendingCancelQueue_;
 
   // Set of operations waiting to be executed at a specific time.
   timer_heap timers_;
@@ -260,17 +703,27 @@ class io_uring_context {
   std::uint32_t sqUnflushedCount_ = 0;
 
   // Number of submitted operations that have not yet received a completion.
-  // We should ensure this number is never greater than cqEntryCount_ so that
-  // we don't end up with an overflowed completion queue.
+  // Only unlimited requests may take this over inFlightLimit_, so that we
+  // don't normally end up with an overflowed completion queue.
   std::uint32_t cqPendingCount_ = 0;
 
+  // Whether the I/O thread has marked the remote queue inactive and is
+  // waiting to be signalled, and whether the eventfd poll is armed.
   bool remoteQueueReadSubmitted_ = false;
+  bool remoteQueuePollSubmitted_ = false;
   bool timersAreDirty_ = false;
 
   std::uint32_t activeTimerCount_ = 0;
 
   __kernel_timespec time_;
 
+  // See statistics.
+  std::atomic<std::uint64_t> submittedCount_{0};
+  std::atomic<std::uint64_t> completedCount_{0};
+  std::atomic<std::uint64_t> deferredCount_{0};
+  std::atomic<std::uint64_t> overflowFlushCount_{0};
+  std::atomic<std::uint64_t> busyRetryCount_{0};
+
   //////////////////
   // Data that is modified by remote threads
 
@@ -289,42 +742,84 @@ void io_uring_context::run(StopToken stopToken) {
 
 template <typename PopulateFn>
 bool io_uring_context::try_submit_io(PopulateFn populateSqe) noexcept {
-  UNIFEX_ASSERT(is_running_on_io_thread());
-
-  if (pending_operation_count() < cqEntryCount_) {
-    // Haven't reached limit of completion-queue yet.
-    const auto tail = sqTail_->load(std::memory_order_relaxed);
-    const auto head = sqHead_->load(std::memory_order_acquire);
-    const auto usedCount = (tail - head);
-    UNIFEX_ASSERT(usedCount <= sqEntryCount_);
-    if (usedCount < sqEntryCount_) {
-      // There is space in the submission-queue.
-      const auto index = tail & sqMask_;
-      auto& sqe = sqEntries_[index];
+  // Haven't reached the in-flight limit yet?
+  return pending_operation_count() < inFlightLimit_ &&
+      try_submit_unlimited_io(std::move(populateSqe));
+}
 
-      static_assert(noexcept(populateSqe(sqe)));
+template <typename PopulateFn>
+bool io_uring_context::try_submit_io(
+    std::uint32_t count, PopulateFn populateSqe) noexcept {
+  return pending_operation_count() + count <= inFlightLimit_ &&
+      try_submit_unlimited_io(count, std::move(populateSqe));
+}
 
-      // nullify the struct
-      std::memset(&sqe, 0, sizeof(sqe));
+template <typename PopulateFn>
+bool io_uring_context::try_submit_unlimited_io(
+    PopulateFn populateSqe) noexcept {
+  UNIFEX_ASSERT(is_running_on_io_thread());
 
-      if constexpr (std::is_void_v<decltype(populateSqe(sqe))>) {
-        populateSqe(sqe);
-      } else {
-        if (!populateSqe(sqe)) {
-          return false;
-        }
+  const auto tail = sqTail_->load(std::memory_order_relaxed);
+  const auto head = sqHead_->load(std::memory_order_acquire);
+  const auto usedCount = (tail - head);
+  UNIFEX_ASSERT(usedCount <= sqEntryCount_);
+  if (usedCount < sqEntryCount_) {
+    // There is space in the submission-queue.
+    const auto index = tail & sqMask_;
+    auto& sqe = sqEntries_[index];
+
+    static_assert(noexcept(populateSqe(sqe)));
+
+    // nullify the struct
+    std::memset(&sqe, 0, sizeof(sqe));
+
+    if constexpr (std::is_void_v<decltype(populateSqe(sqe))>) {
+      populateSqe(sqe);
+    } else {
+      if (!populateSqe(sqe)) {
+        return false;
       }
-
-      sqIndexArray_[index] = index;
-      sqTail_->store(tail + 1, std::memory_order_release);
-      ++sqUnflushedCount_;
-      return true;
     }
+
+    sqIndexArray_[index] = index;
+    sqTail_->store(tail + 1, std::memory_order_release);
+    ++sqUnflushedCount_;
+    increment(submittedCount_);
+    return true;
   }
 
   return false;
 }
 
+template <typename PopulateFn>
+bool io_uring_context::try_submit_unlimited_io(
+    std::uint32_t count, PopulateFn populateSqe) noexcept {
+  UNIFEX_ASSERT(is_running_on_io_thread());
+
+  const auto tail = sqTail_->load(std::memory_order_relaxed);
+  const auto head = sqHead_->load(std::memory_order_acquire);
+  const auto usedCount = (tail - head);
+  UNIFEX_ASSERT(usedCount <= sqEntryCount_);
+  if (sqEntryCount_ - usedCount < count) {
+    return false;
+  }
+
+  static_assert(noexcept(populateSqe(sqEntries_[0], 0u)));
+
+  for (std::uint32_t i = 0; i < count; ++i) {
+    const auto index = (tail + i) & sqMask_;
+    auto& sqe = sqEntries_[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    populateSqe(sqe, i);
+    sqIndexArray_[index] = index;
+  }
+
+  sqTail_->store(tail + count, std::memory_order_release);
+  sqUnflushedCount_ += count;
+  increment(submittedCount_, count);
+  return true;
+}
+
 class io_uring_context::schedule_sender {
   template <typename Receiver>
   class operation : private operation_base {
@@ -397,139 +892,166 @@ class io_uring_context::schedule_sender {
   io_uring_context& context_;
 };
 
-class io_uring_context::read_sender {
-  using offset_t = std::int64_t;
-
+// Completes on the I/O thread once the context can submit another request
+// straight away: the in-flight limit has not been reached and no other
+// operation is waiting for room. Starting I/O from the continuation lets
+// producers slow down to the pace of the ring instead of queueing operations
+// inside the context without bound.
+//
+// Stop requests are only noticed once there is room, which completes the
+// sender with done.
+class io_uring_context::capacity_sender {
   template <typename Receiver>
-  class operation : private completion_base {
-    friend io_uring_context;
-
+  class operation : private operation_base {
    public:
-    template <typename Receiver2>
-    explicit operation(const read_sender& sender, Receiver2&& r)
-        : context_(sender.context_),
-          fd_(sender.fd_),
-          offset_(sender.offset_),
-          receiver_((Receiver2 &&) r) {
-      buffer_[0].iov_base = sender.buffer_.data();
-      buffer_[0].iov_len = sender.buffer_.size();
-    }
-
     void start() noexcept {
       if (!context_.is_running_on_io_thread()) {
         this->execute_ = &operation::on_schedule_complete;
         context_.schedule_remote(this);
       } else {
-        start_io();
+        wait();
       }
     }
 
    private:
+    friend capacity_sender;
+
+    template <typename Receiver2>
+    explicit operation(io_uring_context& context, Receiver2&& r)
+        : context_(context), receiver_((Receiver2 &&) r) {}
+
     static void on_schedule_complete(operation_base* op) noexcept {
-      static_cast<operation*>(op)->start_io();
+      static_cast<operation*>(op)->wait();
     }
 
-    void start_io() noexcept {
+    void wait() noexcept {
       UNIFEX_ASSERT(context_.is_running_on_io_thread());
-
-      auto populateSqe = [this](io_uring_sqe & sqe) noexcept {
-        sqe.opcode = IORING_OP_READV;
-        sqe.fd = fd_;
-        sqe.off = offset_;
-        sqe.addr = reinterpret_cast<std::uintptr_t>(&buffer_[0]);
-        sqe.len = 1;
-        sqe.user_data = reinterpret_cast<std::uintptr_t>(
-            static_cast<completion_base*>(this));
-
-        this->execute_ = &operation::on_read_complete;
-      };
-
-      if (!context_.try_submit_io(populateSqe)) {
-        this->execute_ = &operation::on_schedule_complete;
+      if (context_.pendingIoQueue_.empty() && context_.can_submit_io()) {
+        complete();
+      } else {
+        // The run loop resumes waiting operations in order as soon as
+        // there is room.
+        this->execute_ = &operation::on_capacity_available;
         context_.schedule_pending_io(this);
       }
     }
 
-    static void on_read_complete(operation_base* op) noexcept {
-      auto& self = *static_cast<operation*>(op);
-      if (self.result_ >= 0) {
-        if constexpr (noexcept(unifex::set_value(std::move(self.receiver_), ssize_t(self.result_)))) {
-          unifex::set_value(std::move(self.receiver_), ssize_t(self.result_));
-        } else {
-          UNIFEX_TRY {
-            unifex::set_value(std::move(self.receiver_), ssize_t(self.result_));
-          } UNIFEX_CATCH (...) {
-            unifex::set_error(std::move(self.receiver_), std::current_exception());
-          }
+    static void on_capacity_available(operation_base* op) noexcept {
+      static_cast<operation*>(op)->complete();
+    }
+
+    void complete() noexcept {
+      if constexpr (!is_stop_never_possible_v<stop_token_type_t<Receiver>>) {
+        if (get_stop_token(receiver_).stop_requested()) {
+          unifex::set_done(static_cast<Receiver&&>(receiver_));
+          return;
         }
-      } else if (self.result_ == -ECANCELED) {
-        unifex::set_done(std::move(self.receiver_));
-      } else {
+      }
+
+      UNIFEX_TRY {
+        unifex::set_value(static_cast<Receiver&&>(receiver_));
+      } UNIFEX_CATCH (...) {
         unifex::set_error(
-            std::move(self.receiver_),
-            std::error_code{-self.result_, std::system_category()});
+            static_cast<Receiver&&>(receiver_), std::current_exception());
       }
     }
 
     io_uring_context& context_;
-    int fd_;
-    offset_t offset_;
-    iovec buffer_[1];
     Receiver receiver_;
   };
 
  public:
-  // Produces number of bytes read.
   template <
       template <typename...> class Variant,
       template <typename...> class Tuple>
-  using value_types = Variant<Tuple<ssize_t>>;
+  using value_types = Variant<Tuple<>>;
 
-  // Note: Only case it might complete with exception_ptr is if the
-  // receiver's set_value() exits with an exception.
   template <template <typename...> class Variant>
-  using error_types = Variant<std::error_code, std::exception_ptr>;
+  using error_types = Variant<std::exception_ptr>;
 
   static constexpr bool sends_done = true;
 
-  explicit read_sender(
-      io_uring_context& context,
-      int fd,
-      offset_t offset,
-      span<std::byte> buffer) noexcept
-      : context_(context), fd_(fd), offset_(offset), buffer_(buffer) {}
-
   template <typename Receiver>
-  operation<remove_cvref_t<Receiver>> connect(Receiver&& r) && {
-    return operation<remove_cvref_t<Receiver>>{*this, (Receiver &&) r};
+  operation<remove_cvref_t<Receiver>> connect(Receiver&& r) {
+    return operation<remove_cvref_t<Receiver>>{context_, (Receiver &&) r};
   }
 
  private:
+  friend io_uring_context::scheduler;
+
+  explicit capacity_sender(io_uring_context& context) noexcept
+      : context_(context) {}
+
   io_uring_context& context_;
-  int fd_;
-  offset_t offset_;
-  span<std::byte> buffer_;
 };
 
-class io_uring_context::write_sender {
-  using offset_t = std::int64_t;
+// Submits a single SQE and completes with its result.
+//
+// IoOp provides:
+// - populate(io_uring_sqe&) that fills in everything but the user_data
+// - result(int) that maps a non-negative CQE result to the value the sender
+//   produces, or returns void if the sender produces no value.
+//
+// Negative results complete with an error_code, or with done if the
+// operation was cancelled.
+//
+// IoOp may also provide validate() returning an errno value if the request
+// is known to fail, in which case the sender completes with that error
+// without submitting anything. link() checks every request of a chain the
+// same way before submitting any of it.
+//
+// IoOp may also provide prepare(allocator) and release(allocator) to
+// allocate any memory the request needs from the receiver's allocator when
+// the operation is connected, and to free it when the operation is
+// destroyed. release() must do nothing if prepare() was never called.
+//
+// with_timeout() and with_deadline() link an IORING_OP_LINK_TIMEOUT to the
+// request so that the kernel cancels it if it has not completed in time, in
+// which case the sender completes with std::errc::timed_out.
+template <typename IoOp>
+class io_uring_context::io_sender {
+  using result_t = decltype(UNIFEX_DECLVAL(IoOp&).result(0));
+
+  struct timeout_spec {
+    __kernel_timespec time_;
+    bool absolute_;
+  };
+
+  template <template <typename...> class Tuple, typename T>
+  struct value_tuple {
+    using type = Tuple<T>;
+  };
+  template <template <typename...> class Tuple>
+  struct value_tuple<Tuple, void> {
+    using type = Tuple<>;
+  };
 
   template <typename Receiver>
   class operation : private completion_base {
     friend io_uring_context;
 
+    static constexpr bool is_stop_ever_possible =
+        !is_stop_never_possible_v<stop_token_type_t<Receiver>>;
+
    public:
     template <typename Receiver2>
-    explicit operation(const write_sender& sender, Receiver2&& r)
+    explicit operation(io_sender&& sender, Receiver2&& r)
         : context_(sender.context_),
-          fd_(sender.fd_),
-          offset_(sender.offset_),
-          receiver_((Receiver2 &&) r) {
-      buffer_[0].iov_base = (void*)sender.buffer_.data();
-      buffer_[0].iov_len = sender.buffer_.size();
+          io_(std::move(sender.io_)),
+          timeout_(sender.timeout_),
+          receiver_((Receiver2 &&) r),
+          allocator_(get_allocator(receiver_)) {
+      prepare_io(io_, allocator_, 0);
     }
 
+    ~operation() { release_io(io_, allocator_, 0); }
+
     void start() noexcept {
+      if constexpr (is_stop_ever_possible) {
+        stopCallback_.construct(
+            get_stop_token(receiver_), cancel_callback{*this});
+      }
+
       if (!context_.is_running_on_io_thread()) {
         this->execute_ = &operation::on_schedule_complete;
         context_.schedule_remote(this);
@@ -545,59 +1067,239 @@ class io_uring_context::write_sender {
 
     void start_io() noexcept {
       UNIFEX_ASSERT(context_.is_running_on_io_thread());
+      const bool retrying = std::exchange(waitingForCapacity_, false);
+
+      if constexpr (is_stop_ever_possible) {
+        if (cancelRequested_.load(std::memory_order_acquire)) {
+          // Stop was requested before the operation was submitted.
+          this->result_ = -ECANCELED;
+          complete();
+          return;
+        }
+      }
+
+      if (const int error = validate_io(io_, 0); error != 0) {
+        this->result_ = -error;
+        complete();
+        return;
+      }
+
+      if (timeout_.has_value() && !context_.fits_in_flight_limit(2)) {
+        // Would wait forever for room for the request and its timeout.
+        this->result_ = -EINVAL;
+        complete();
+        return;
+      }
 
       auto populateSqe = [this](io_uring_sqe & sqe) noexcept {
-        sqe.opcode = IORING_OP_WRITEV;
-        sqe.fd = fd_;
-        sqe.off = offset_;
-        sqe.addr = reinterpret_cast<std::uintptr_t>(&buffer_[0]);
-        sqe.len = 1;
+        io_.populate(sqe);
         sqe.user_data = reinterpret_cast<std::uintptr_t>(
             static_cast<completion_base*>(this));
 
-        this->execute_ = &operation::on_write_complete;
+        this->execute_ = &operation::on_complete;
       };
 
-      if (!context_.try_submit_io(populateSqe)) {
-        this->execute_ = &operation::on_schedule_complete;
-        context_.schedule_pending_io(this);
+      bool submitted;
+      if (timeout_.has_value()) {
+        submitted = context_.try_submit_io(
+            2, [&](io_uring_sqe & sqe, std::uint32_t index) noexcept {
+              if (index == 0) {
+                populateSqe(sqe);
+                sqe.flags |= IOSQE_IO_LINK;
+              } else {
+                sqe.opcode = IORING_OP_LINK_TIMEOUT;
+                sqe.addr = reinterpret_cast<std::uintptr_t>(&timeout_->time_);
+                sqe.len = 1;
+                sqe.timeout_flags =
+                    timeout_->absolute_ ? IORING_TIMEOUT_ABS : 0;
+                sqe.user_data = reinterpret_cast<std::uintptr_t>(
+                    static_cast<completion_base*>(&timeoutOp_));
+                timeoutOp_.execute_ = &operation::on_timeout_complete;
+              }
+            });
+        // Wait for the completion of both the request and the timeout.
+        pendingCount_ = 2;
+      } else {
+        submitted = context_.try_submit_io(populateSqe);
+        pendingCount_ = 1;
+      }
+
+      if (submitted) {
+        submitted_ = true;
+      } else {
+        this->execute_ = &operation::on_capacity_available;
+        waitingForCapacity_ = true;
+        if (retrying) {
+          // There was room for one request but not for its timeout.
+          context_.reschedule_pending_io(this);
+        } else {
+          context_.schedule_pending_io(this);
+        }
       }
     }
 
-    static void on_write_complete(operation_base* op) noexcept {
+    static void on_capacity_available(operation_base* op) noexcept {
+      static_cast<operation*>(op)->start_io();
+    }
+
+    static void on_complete(operation_base* op) noexcept {
       auto& self = *static_cast<operation*>(op);
-      if (self.result_ >= 0) {
-        if constexpr (noexcept(unifex::set_value(std::move(self.receiver_), ssize_t(self.result_)))) {
-          unifex::set_value(std::move(self.receiver_), ssize_t(self.result_));
-        } else {
-          UNIFEX_TRY {
-            unifex::set_value(std::move(self.receiver_), ssize_t(self.result_));
-          } UNIFEX_CATCH (...) {
-            unifex::set_error(std::move(self.receiver_), std::current_exception());
+      if (--self.pendingCount_ == 0) {
+        self.complete();
+      }
+    }
+
+    static void on_timeout_complete(operation_base* op) noexcept {
+      auto& self = *static_cast<timeout_operation*>(op)->op_;
+      // -ETIME if the timeout fired, otherwise it was cancelled because
+      // the request completed first.
+      self.timedOut_ = static_cast<completion_base&>(self.timeoutOp_).result_ ==
+          -ETIME;
+      if (--self.pendingCount_ == 0) {
+        self.complete();
+      }
+    }
+
+    void complete() noexcept {
+      if constexpr (is_stop_ever_possible) {
+        // Waits for a concurrent call to request_stop() to return.
+        stopCallback_.destruct();
+
+        if (cancelRequested_.load(std::memory_order_acquire) && !cancelRan_) {
+          // The queued cancellation still refers to this operation. It
+          // delivers the result once it has run.
+          completed_ = true;
+          return;
+        }
+      }
+
+      deliver();
+    }
+
+    void deliver() noexcept {
+      if (this->result_ == -ECANCELED && timedOut_) {
+        this->result_ = -ETIMEDOUT;
+      }
+
+      if (this->result_ >= 0) {
+        UNIFEX_TRY {
+          if constexpr (std::is_void_v<result_t>) {
+            io_.result(this->result_);
+            unifex::set_value(std::move(receiver_));
+          } else {
+            unifex::set_value(std::move(receiver_), io_.result(this->result_));
           }
+        } UNIFEX_CATCH (...) {
+          unifex::set_error(std::move(receiver_), std::current_exception());
         }
-      } else if (self.result_ == -ECANCELED) {
-        unifex::set_done(std::move(self.receiver_));
+      } else if (this->result_ == -ECANCELED) {
+        unifex::set_done(std::move(receiver_));
       } else {
         unifex::set_error(
-            std::move(self.receiver_),
-            std::error_code{-self.result_, std::system_category()});
+            std::move(receiver_),
+            std::error_code{-this->result_, std::system_category()});
+      }
+    }
+
+    // Called on any thread. Hands the cancellation over to the I/O thread.
+    void request_stop() noexcept {
+      cancelRequested_.store(true, std::memory_order_release);
+      cancelOp_.execute_ = &operation::on_cancel;
+      if (context_.is_running_on_io_thread()) {
+        context_.schedule_local(&cancelOp_);
+      } else {
+        context_.schedule_remote(&cancelOp_);
+      }
+    }
+
+    static void on_cancel(operation_base* op) noexcept {
+      auto& self = *static_cast<cancel_operation*>(op)->op_;
+      UNIFEX_ASSERT(self.context_.is_running_on_io_thread());
+
+      if (self.completed_) {
+        self.cancelRan_ = true;
+        self.deliver();
+        return;
+      }
+
+      if (self.waitingForCapacity_) {
+        // Room may not come up for a while, don't wait for it.
+        self.context_.remove_pending_io(&self);
+        self.waitingForCapacity_ = false;
+        self.cancelRan_ = true;
+        self.result_ = -ECANCELED;
+        self.complete();
+        return;
+      }
+
+      if (!self.submitted_) {
+        // start_io() has not run yet and will see the cancellation.
+        self.cancelRan_ = true;
+        return;
+      }
+
+      auto populateSqe = [&self](io_uring_sqe & sqe) noexcept {
+        sqe.opcode = IORING_OP_ASYNC_CANCEL;
+        sqe.addr = reinterpret_cast<std::uintptr_t>(
+            static_cast<completion_base*>(&self));
+        sqe.user_data = self.context_.cancel_user_data();
+      };
+
+      if (self.context_.try_submit_unlimited_io(populateSqe)) {
+        // The operation now completes with -ECANCELED, or with its result if
+        // it was too late to cancel it.
+        self.cancelRan_ = true;
+      } else {
+        self.context_.schedule_pending_cancel(op);
       }
     }
 
+    struct cancel_callback {
+      operation& op_;
+
+      void operator()() noexcept {
+        op_.request_stop();
+      }
+    };
+
+    struct cancel_operation : operation_base {
+      explicit cancel_operation(operation* op) noexcept : op_(op) {}
+      operation* op_;
+    };
+
+    struct timeout_operation : completion_base {
+      explicit timeout_operation(operation* op) noexcept : op_(op) {}
+      operation* op_;
+    };
+
     io_uring_context& context_;
-    int fd_;
-    offset_t offset_;
-    iovec buffer_[1];
+    IoOp io_;
+    std::optional<timeout_spec> timeout_;
     Receiver receiver_;
+    UNIFEX_NO_UNIQUE_ADDRESS
+    remove_cvref_t<get_allocator_t<const Receiver&>> allocator_;
+    manual_lifetime<typename stop_token_type_t<
+        Receiver>::template callback_type<cancel_callback>>
+        stopCallback_;
+    cancel_operation cancelOp_{this};
+    timeout_operation timeoutOp_{this};
+    std::atomic<bool> cancelRequested_{false};
+
+    // Only accessed on the I/O thread.
+    std::uint32_t pendingCount_ = 0;
+    bool timedOut_ = false;
+    bool submitted_ = false;
+    // Whether the operation is in the pending I/O queue.
+    bool waitingForCapacity_ = false;
+    bool cancelRan_ = false;
+    bool completed_ = false;
   };
 
  public:
-  // Produces number of bytes read.
   template <
       template <typename...> class Variant,
       template <typename...> class Tuple>
-  using value_types = Variant<Tuple<ssize_t>>;
+  using value_types = Variant<typename value_tuple<Tuple, result_t>::type>;
 
   // Note: Only case it might complete with exception_ptr is if the
   // receiver's set_value() exits with an exception.
@@ -606,85 +1308,1612 @@ class io_uring_context::write_sender {
 
   static constexpr bool sends_done = true;
 
-  explicit write_sender(
-      io_uring_context& context,
-      int fd,
-      offset_t offset,
-      span<const std::byte> buffer) noexcept
-      : context_(context), fd_(fd), offset_(offset), buffer_(buffer) {}
+  explicit io_sender(io_uring_context& context, IoOp io) noexcept
+      : context_(context), io_(std::move(io)) {}
+
+  // Fail with std::errc::timed_out unless the operation completes within
+  // 'timeout' of being submitted.
+  template <typename Rep, typename Ratio>
+  io_sender
+  with_timeout(std::chrono::duration<Rep, Ratio> timeout) && noexcept {
+    const auto seconds =
+        std::chrono::duration_cast<std::chrono::seconds>(timeout);
+    timeout_.emplace();
+    timeout_->time_.tv_sec = seconds.count();
+    timeout_->time_.tv_nsec =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(timeout - seconds)
+            .count();
+    timeout_->absolute_ = false;
+    return std::move(*this);
+  }
+
+  // Fail with std::errc::timed_out unless the operation completes before
+  // 'deadline'.
+  io_sender with_deadline(const time_point& deadline) && noexcept {
+    timeout_.emplace();
+    timeout_->time_.tv_sec = deadline.seconds_part();
+    timeout_->time_.tv_nsec = deadline.nanoseconds_part();
+    timeout_->absolute_ = true;
+    return std::move(*this);
+  }
 
   template <typename Receiver>
-  operation<remove_cvref_t<Receiver>> connect(Receiver&& r) {
-    return operation<remove_cvref_t<Receiver>>{*this, (Receiver &&) r};
+  operation<remove_cvref_t<Receiver>> connect(Receiver&& r) && {
+    return operation<remove_cvref_t<Receiver>>{
+        std::move(*this), (Receiver &&) r};
+  }
+
+  template <typename Receiver>
+  operation<remove_cvref_t<Receiver>> connect(Receiver&& r) const& {
+    return operation<remove_cvref_t<Receiver>>{
+        io_sender{*this}, (Receiver &&) r};
+  }
+
+ private:
+  friend io_uring_context;
+
+  io_uring_context& context_;
+  IoOp io_;
+  std::optional<timeout_spec> timeout_;
+};
+
+// Submits the requests of each of the senders as one IOSQE_IO_LINK chain.
+//
+// If a request fails, the kernel cancels the rest of the chain and the sender
+// completes with the error of the first failed request. A chain broken by a
+// short read or write completes with std::errc::operation_canceled.
+template <typename... IoOps>
+class io_uring_context::link_sender {
+  static constexpr std::uint32_t step_count = sizeof...(IoOps);
+  static_assert(step_count > 0);
+
+  template <typename IoOp>
+  using result_of = decltype(UNIFEX_DECLVAL(IoOp&).result(0));
+
+  template <typename IoOp>
+  using step_values = std::conditional_t<
+      std::is_void_v<result_of<IoOp>>,
+      type_list<>,
+      type_list<result_of<IoOp>>>;
+
+  using values = concat_type_lists_t<step_values<IoOps>...>;
+
+  template <typename Receiver>
+  class operation {
+    friend io_uring_context;
+
+    static constexpr bool is_stop_ever_possible =
+        !is_stop_never_possible_v<stop_token_type_t<Receiver>>;
+
+   public:
+    template <typename Receiver2>
+    explicit operation(link_sender&& sender, Receiver2&& r)
+        : context_(sender.context_),
+          ios_(std::move(sender.ios_)),
+          receiver_((Receiver2 &&) r),
+          allocator_(get_allocator(receiver_)) {
+      UNIFEX_TRY {
+        std::apply(
+            [this](IoOps&... ios) { (prepare_io(ios, allocator_, 0), ...); },
+            ios_);
+      } UNIFEX_CATCH (...) {
+        release();
+        UNIFEX_RETHROW();
+      }
+    }
+
+    ~operation() { release(); }
+
+    void start() noexcept {
+      if constexpr (is_stop_ever_possible) {
+        stopCallback_.construct(
+            get_stop_token(receiver_), cancel_callback{*this});
+      }
+
+      if (!context_.is_running_on_io_thread()) {
+        startOp_.execute_ = &operation::on_schedule_complete;
+        context_.schedule_remote(&startOp_);
+      } else {
+        start_io();
+      }
+    }
+
+   private:
+    struct step : completion_base {
+      operation* op_;
+    };
+
+    struct start_operation : operation_base {
+      explicit start_operation(operation* op) noexcept : op_(op) {}
+      operation* op_;
+    };
+
+    static void on_schedule_complete(operation_base* op) noexcept {
+      static_cast<start_operation*>(op)->op_->start_io();
+    }
+
+    void start_io() noexcept {
+      UNIFEX_ASSERT(context_.is_running_on_io_thread());
+      const bool retrying = std::exchange(waitingForCapacity_, false);
+
+      if constexpr (is_stop_ever_possible) {
+        if (cancelRequested_.load(std::memory_order_acquire)) {
+          // Stop was requested before the chain was submitted.
+          complete();
+          return;
+        }
+      }
+
+      // Check every request before submitting any of them, the kernel would
+      // otherwise run the ones before an invalid request.
+      int error = 0;
+      std::uint32_t failedIndex = 0;
+      auto check = [&](const auto& io) noexcept {
+        error = validate_io(io, 0);
+        if (error == 0) {
+          ++failedIndex;
+        }
+        return error != 0;
+      };
+      std::apply(
+          [&](const IoOps&... ios) noexcept { (void)(check(ios) || ...); },
+          ios_);
+      if (error != 0) {
+        fail(failedIndex, error);
+        return;
+      }
+
+      const bool submitted = context_.try_submit_io(
+          step_count, [this](io_uring_sqe & sqe, std::uint32_t index) noexcept {
+            populate(sqe, index, std::index_sequence_for<IoOps...>{});
+            if (index + 1 < step_count) {
+              sqe.flags |= IOSQE_IO_LINK;
+            }
+            auto& s = steps_[index];
+            s.op_ = this;
+            s.execute_ = &operation::on_step_complete;
+            sqe.user_data = reinterpret_cast<std::uintptr_t>(
+                static_cast<completion_base*>(&s));
+          });
+
+      if (submitted) {
+        submitted_ = true;
+        pendingCount_ = step_count;
+      } else {
+        startOp_.execute_ = &operation::on_capacity_available;
+        waitingForCapacity_ = true;
+        if (retrying) {
+          // There was room for some of the chain but not all of it.
+          context_.reschedule_pending_io(&startOp_);
+        } else {
+          context_.schedule_pending_io(&startOp_);
+        }
+      }
+    }
+
+    static void on_capacity_available(operation_base* op) noexcept {
+      static_cast<start_operation*>(op)->op_->start_io();
+    }
+
+    // Complete with 'error' for request 'index' without submitting the
+    // chain, as if it had failed and the kernel had cancelled the others.
+    void fail(std::uint32_t index, int error) noexcept {
+      for (auto& s : steps_) {
+        s.result_ = -ECANCELED;
+      }
+      steps_[index].result_ = -error;
+      // So that deliver() reports the results of the steps.
+      submitted_ = true;
+      complete();
+    }
+
+    // Frees whatever prepare_io() allocated for each of the requests. Safe
+    // to call for requests that were never prepared.
+    void release() noexcept {
+      std::apply(
+          [this](IoOps&... ios) noexcept {
+            (release_io(ios, allocator_, 0), ...);
+          },
+          ios_);
+    }
+
+    template <std::size_t... Is>
+    void populate(
+        io_uring_sqe& sqe,
+        std::uint32_t index,
+        std::index_sequence<Is...>) noexcept {
+      (void)((Is == index ? (std::get<Is>(ios_).populate(sqe), true)
+                          : false) ||
+             ...);
+    }
+
+    static void on_step_complete(operation_base* op) noexcept {
+      auto& self = *static_cast<step*>(op)->op_;
+      if (--self.pendingCount_ == 0) {
+        self.complete();
+      }
+    }
+
+    void complete() noexcept {
+      if constexpr (is_stop_ever_possible) {
+        // Waits for a concurrent call to request_stop() to return.
+        stopCallback_.destruct();
+
+        if (cancelRequested_.load(std::memory_order_acquire) && !cancelRan_) {
+          // The queued cancellation still refers to this operation. It
+          // delivers the result once it has run.
+          completed_ = true;
+          return;
+        }
+      }
+
+      deliver();
+    }
+
+    void deliver() noexcept {
+      if (!submitted_) {
+        if constexpr (is_stop_ever_possible) {
+          unifex::set_done(std::move(receiver_));
+        }
+        return;
+      }
+
+      int error = 0;
+      bool cancelled = false;
+      for (auto& s : steps_) {
+        if (s.result_ == -ECANCELED) {
+          cancelled = true;
+        } else if (s.result_ < 0 && error == 0) {
+          error = -s.result_;
+        }
+      }
+
+      if (error != 0) {
+        unifex::set_error(
+            std::move(receiver_),
+            std::error_code{error, std::system_category()});
+      } else if (cancelled) {
+        if (cancelRequested_.load(std::memory_order_relaxed)) {
+          unifex::set_done(std::move(receiver_));
+        } else {
+          unifex::set_error(
+              std::move(receiver_),
+              std::make_error_code(std::errc::operation_canceled));
+        }
+      } else {
+        UNIFEX_TRY {
+          std::apply(
+              [this](auto&&... values) {
+                unifex::set_value(std::move(receiver_), std::move(values)...);
+              },
+              results(std::index_sequence_for<IoOps...>{}));
+        } UNIFEX_CATCH (...) {
+          unifex::set_error(std::move(receiver_), std::current_exception());
+        }
+      }
+    }
+
+    template <std::size_t... Is>
+    auto results(std::index_sequence<Is...>) {
+      return std::tuple_cat(result<Is>()...);
+    }
+
+    template <std::size_t I>
+    auto result() {
+      auto& io = std::get<I>(ios_);
+      if constexpr (std::is_void_v<decltype(io.result(0))>) {
+        io.result(steps_[I].result_);
+        return std::tuple<>{};
+      } else {
+        return std::tuple{io.result(steps_[I].result_)};
+      }
+    }
+
+    // Called on any thread. Hands the cancellation over to the I/O thread.
+    void request_stop() noexcept {
+      cancelRequested_.store(true, std::memory_order_release);
+      cancelOp_.execute_ = &operation::on_cancel;
+      if (context_.is_running_on_io_thread()) {
+        context_.schedule_local(&cancelOp_);
+      } else {
+        context_.schedule_remote(&cancelOp_);
+      }
+    }
+
+    static void on_cancel(operation_base* op) noexcept {
+      auto& self = *static_cast<start_operation*>(op)->op_;
+      UNIFEX_ASSERT(self.context_.is_running_on_io_thread());
+
+      if (self.completed_) {
+        self.cancelRan_ = true;
+        self.deliver();
+        return;
+      }
+
+      if (self.waitingForCapacity_) {
+        // Room may not come up for a while, don't wait for it.
+        self.context_.remove_pending_io(&self.startOp_);
+        self.waitingForCapacity_ = false;
+        self.cancelRan_ = true;
+        self.complete();
+        return;
+      }
+
+      if (!self.submitted_) {
+        // start_io() has not run yet and will see the cancellation.
+        self.cancelRan_ = true;
+        return;
+      }
+
+      // Cancel every request of the chain. Those that have already
+      // completed are not found.
+      auto populateSqe = [&self](
+                             io_uring_sqe & sqe, std::uint32_t index) noexcept {
+        sqe.opcode = IORING_OP_ASYNC_CANCEL;
+        sqe.addr = reinterpret_cast<std::uintptr_t>(
+            static_cast<completion_base*>(&self.steps_[index]));
+        sqe.user_data = self.context_.cancel_user_data();
+      };
+
+      if (self.context_.try_submit_unlimited_io(step_count, populateSqe)) {
+        self.cancelRan_ = true;
+      } else {
+        self.context_.schedule_pending_cancel(op);
+      }
+    }
+
+    struct cancel_callback {
+      operation& op_;
+
+      void operator()() noexcept {
+        op_.request_stop();
+      }
+    };
+
+    io_uring_context& context_;
+    std::tuple<IoOps...> ios_;
+    Receiver receiver_;
+    UNIFEX_NO_UNIQUE_ADDRESS
+    remove_cvref_t<get_allocator_t<const Receiver&>> allocator_;
+    manual_lifetime<typename stop_token_type_t<
+        Receiver>::template callback_type<cancel_callback>>
+        stopCallback_;
+    step steps_[step_count];
+    start_operation startOp_{this};
+    start_operation cancelOp_{this};
+    std::atomic<bool> cancelRequested_{false};
+
+    // Only accessed on the I/O thread.
+    std::uint32_t pendingCount_ = 0;
+    bool submitted_ = false;
+    // Whether startOp_ is in the pending I/O queue.
+    bool waitingForCapacity_ = false;
+    bool cancelRan_ = false;
+    bool completed_ = false;
+  };
+
+ public:
+  template <
+      template <typename...> class Variant,
+      template <typename...> class Tuple>
+  using value_types = Variant<typename values::template apply<Tuple>>;
+
+  // Note: Only case it might complete with exception_ptr is if the
+  // receiver's set_value() exits with an exception.
+  template <template <typename...> class Variant>
+  using error_types = Variant<std::error_code, std::exception_ptr>;
+
+  static constexpr bool sends_done = true;
+
+  explicit link_sender(io_uring_context& context, std::tuple<IoOps...> ios)
+      noexcept
+    : context_(context), ios_(std::move(ios)) {}
+
+  template <typename Receiver>
+  operation<remove_cvref_t<Receiver>> connect(Receiver&& r) && {
+    return operation<remove_cvref_t<Receiver>>{
+        std::move(*this), (Receiver &&) r};
+  }
+
+  template <typename Receiver>
+  operation<remove_cvref_t<Receiver>> connect(Receiver&& r) const& {
+    return operation<remove_cvref_t<Receiver>>{
+        link_sender{*this}, (Receiver &&) r};
+  }
+
+ private:
+  io_uring_context& context_;
+  std::tuple<IoOps...> ios_;
+};
+
+template <typename... IoOps>
+io_uring_context::link_sender<IoOps...>
+io_uring_context::link(io_sender<IoOps>... senders) {
+  static_assert(sizeof...(IoOps) > 0);
+  io_uring_context* contexts[] = {&senders.context_...};
+  for (auto* context : contexts) {
+    UNIFEX_ASSERT(context == contexts[0]);
+    (void)context;
+  }
+  // Linked timeouts cannot be part of the chain.
+  UNIFEX_ASSERT((!senders.timeout_.has_value() && ...));
+  if (sizeof...(IoOps) > contexts[0]->sqEntryCount_ ||
+      !contexts[0]->fits_in_flight_limit(sizeof...(IoOps))) {
+    // The chain could never be submitted.
+    throw_(std::system_error{EINVAL, std::system_category()});
+  }
+  return link_sender<IoOps...>{
+      *contexts[0], std::tuple<IoOps...>{std::move(senders.io_)...}};
+}
+
+// A stream of the completions of a multishot request, which keeps posting a
+// completion for each result until it fails, is cancelled or the kernel ends
+// it.
+//
+// The request is submitted by the first next() and completions that arrive
+// while nobody is waiting for them are queued by the stream. If the kernel
+// ends the request without an error it is submitted again. cleanup() cancels
+// the request and discards the completions that were never consumed.
+//
+// MultishotOp provides:
+// - populate(io_uring_sqe&) that fills in everything but the user_data
+// - result(int, std::uint32_t) that maps a non-negative CQE result and the
+//   CQE flags to the next value of the stream
+// - discard(int, std::uint32_t) that releases whatever a non-negative CQE
+//   that is never consumed holds
+// - is_end(int) that tells whether a CQE result marks the end of the stream
+// - is_retryable(int) that tells whether a failure should be retried once
+//   the consumer asks for more, rather than reported
+// - retry_requires_progress, whether a retryable failure is only retried if
+//   the request produced something before failing, as otherwise retrying
+//   could fail the same way forever
+//
+// The stream must not be moved once next() has been called.
+template <typename MultishotOp>
+class io_uring_context::multishot_stream : private multishot_base {
+  using value_t = decltype(UNIFEX_DECLVAL(MultishotOp&).result(0, 0u));
+
+  struct entry {
+    int result_;
+    std::uint32_t flags_;
+  };
+
+  enum class state { idle, pending, submitted };
+
+  template <typename Receiver>
+  class next_operation : private operation_base {
+    static constexpr bool is_stop_ever_possible =
+        !is_stop_never_possible_v<stop_token_type_t<Receiver>>;
+
+   public:
+    template <typename Receiver2>
+    explicit next_operation(multishot_stream& stream, Receiver2&& r)
+        : stream_(stream), receiver_((Receiver2 &&) r) {}
+
+    void start() noexcept {
+      if constexpr (is_stop_ever_possible) {
+        stopCallback_.construct(
+            get_stop_token(receiver_), cancel_callback{*this});
+      }
+
+      if (!stream_.context_.is_running_on_io_thread()) {
+        this->execute_ = &next_operation::on_schedule_complete;
+        stream_.context_.schedule_remote(this);
+      } else {
+        start_io();
+      }
+    }
+
+   private:
+    static void on_schedule_complete(operation_base* op) noexcept {
+      static_cast<next_operation*>(op)->start_io();
+    }
+
+    void start_io() noexcept {
+      UNIFEX_ASSERT(stream_.context_.is_running_on_io_thread());
+      started_ = true;
+
+      if constexpr (is_stop_ever_possible) {
+        if (cancelRequested_.load(std::memory_order_acquire)) {
+          cancelled_ = true;
+          complete();
+          return;
+        }
+      }
+
+      if (stream_.ready()) {
+        complete();
+        return;
+      }
+
+      this->execute_ = &next_operation::on_ready;
+      stream_.waiter_ = this;
+      if (stream_.state_ == state::idle) {
+        stream_.submit();
+      }
+    }
+
+    static void on_ready(operation_base* op) noexcept {
+      static_cast<next_operation*>(op)->complete();
+    }
+
+    void complete() noexcept {
+      if constexpr (is_stop_ever_possible) {
+        // Waits for a concurrent call to request_stop() to return.
+        stopCallback_.destruct();
+
+        if (cancelRequested_.load(std::memory_order_acquire) && !cancelRan_) {
+          // The queued cancellation still refers to this operation. It
+          // delivers the result once it has run.
+          completed_ = true;
+          return;
+        }
+      }
+
+      deliver();
+    }
+
+    void deliver() noexcept {
+      if (cancelled_ || stream_.ended_) {
+        unifex::set_done(std::move(receiver_));
+        return;
+      }
+
+      const entry e = stream_.pop();
+      if (e.result_ < 0) {
+        unifex::set_error(
+            std::move(receiver_),
+            std::error_code{-e.result_, std::system_category()});
+      } else if (stream_.io_.is_end(e.result_)) {
+        stream_.io_.discard(e.result_, e.flags_);
+        stream_.ended_ = true;
+        unifex::set_done(std::move(receiver_));
+      } else {
+        UNIFEX_TRY {
+          unifex::set_value(
+              std::move(receiver_), stream_.io_.result(e.result_, e.flags_));
+        } UNIFEX_CATCH (...) {
+          unifex::set_error(std::move(receiver_), std::current_exception());
+        }
+      }
+    }
+
+    // Called on any thread. Hands the cancellation over to the I/O thread.
+    void request_stop() noexcept {
+      cancelRequested_.store(true, std::memory_order_release);
+      cancelOp_.execute_ = &next_operation::on_cancel;
+      if (stream_.context_.is_running_on_io_thread()) {
+        stream_.context_.schedule_local(&cancelOp_);
+      } else {
+        stream_.context_.schedule_remote(&cancelOp_);
+      }
+    }
+
+    static void on_cancel(operation_base* op) noexcept {
+      auto& self = *static_cast<cancel_operation*>(op)->op_;
+      self.cancelRan_ = true;
+
+      if (self.completed_) {
+        self.deliver();
+      } else if (self.started_ && self.stream_.waiter_ == &self) {
+        // Stop waiting. The request carries on and whatever it produces is
+        // left for the next call to next().
+        self.stream_.waiter_ = nullptr;
+        self.cancelled_ = true;
+        self.complete();
+      }
+      // Otherwise start_io() has not run yet and will see the cancellation,
+      // or the operation is already queued to complete.
+    }
+
+    struct cancel_callback {
+      next_operation& op_;
+
+      void operator()() noexcept {
+        op_.request_stop();
+      }
+    };
+
+    struct cancel_operation : operation_base {
+      explicit cancel_operation(next_operation* op) noexcept : op_(op) {}
+      next_operation* op_;
+    };
+
+    multishot_stream& stream_;
+    Receiver receiver_;
+    manual_lifetime<typename stop_token_type_t<
+        Receiver>::template callback_type<cancel_callback>>
+        stopCallback_;
+    cancel_operation cancelOp_{this};
+    std::atomic<bool> cancelRequested_{false};
+
+    // Only accessed on the I/O thread.
+    bool started_ = false;
+    bool cancelled_ = false;
+    bool cancelRan_ = false;
+    bool completed_ = false;
+  };
+
+  template <typename Receiver>
+  class cleanup_operation : private operation_base {
+   public:
+    template <typename Receiver2>
+    explicit cleanup_operation(multishot_stream& stream, Receiver2&& r)
+        : stream_(stream), receiver_((Receiver2 &&) r) {}
+
+    void start() noexcept {
+      if (!stream_.context_.is_running_on_io_thread()) {
+        this->execute_ = &cleanup_operation::on_schedule_complete;
+        stream_.context_.schedule_remote(this);
+      } else {
+        start_io();
+      }
+    }
+
+   private:
+    static void on_schedule_complete(operation_base* op) noexcept {
+      static_cast<cleanup_operation*>(op)->start_io();
+    }
+
+    void start_io() noexcept {
+      UNIFEX_ASSERT(stream_.context_.is_running_on_io_thread());
+      stream_.closing_ = true;
+      if (stream_.state_ == state::idle) {
+        deliver();
+        return;
+      }
+
+      // Wait for the final completion of the request.
+      this->execute_ = &cleanup_operation::on_ended;
+      stream_.cleanupWaiter_ = this;
+      if (stream_.state_ == state::submitted) {
+        stream_.cancel();
+      }
+    }
+
+    static void on_ended(operation_base* op) noexcept {
+      static_cast<cleanup_operation*>(op)->deliver();
+    }
+
+    void deliver() noexcept {
+      stream_.discard_all();
+      stream_.closing_ = false;
+      // Like every other cleanup sender, completes with done.
+      unifex::set_done(std::move(receiver_));
+    }
+
+    multishot_stream& stream_;
+    Receiver receiver_;
+  };
+
+ public:
+  class next_sender {
+   public:
+    template <
+        template <typename...> class Variant,
+        template <typename...> class Tuple>
+    using value_types = Variant<Tuple<value_t>>;
+
+    // Note: Only case it might complete with exception_ptr is if the
+    // receiver's set_value() exits with an exception.
+    template <template <typename...> class Variant>
+    using error_types = Variant<std::error_code, std::exception_ptr>;
+
+    static constexpr bool sends_done = true;
+
+    template <typename Receiver>
+    next_operation<remove_cvref_t<Receiver>> connect(Receiver&& r) const {
+      return next_operation<remove_cvref_t<Receiver>>{
+          stream_, (Receiver &&) r};
+    }
+
+   private:
+    friend multishot_stream;
+
+    explicit next_sender(multishot_stream& stream) noexcept
+      : stream_(stream) {}
+
+    multishot_stream& stream_;
+  };
+
+  class cleanup_sender {
+   public:
+    template <
+        template <typename...> class Variant,
+        template <typename...> class Tuple>
+    using value_types = Variant<>;
+
+    template <template <typename...> class Variant>
+    using error_types = Variant<>;
+
+    static constexpr bool sends_done = true;
+
+    template <typename Receiver>
+    cleanup_operation<remove_cvref_t<Receiver>> connect(Receiver&& r) const {
+      return cleanup_operation<remove_cvref_t<Receiver>>{
+          stream_, (Receiver &&) r};
+    }
+
+   private:
+    friend multishot_stream;
+
+    explicit cleanup_sender(multishot_stream& stream) noexcept
+      : stream_(stream) {}
+
+    multishot_stream& stream_;
+  };
+
+  explicit multishot_stream(io_uring_context& context, MultishotOp io) noexcept
+    : context_(context), io_(std::move(io)) {
+    this->complete_ = &multishot_stream::on_completion;
+  }
+
+  multishot_stream(multishot_stream&& other) noexcept
+    : context_(other.context_), io_(std::move(other.io_)) {
+    UNIFEX_ASSERT(other.state_ == state::idle && other.entries_.empty());
+    this->complete_ = &multishot_stream::on_completion;
+  }
+
+  ~multishot_stream() {
+    UNIFEX_ASSERT(state_ == state::idle && !queued_);
+    discard_all();
+  }
+
+  friend next_sender tag_invoke(tag_t<next>, multishot_stream& s) noexcept {
+    return s.next_();
+  }
+
+  friend cleanup_sender
+  tag_invoke(tag_t<cleanup>, multishot_stream& s) noexcept {
+    return s.cleanup_();
+  }
+
+ private:
+  next_sender next_() noexcept { return next_sender{*this}; }
+
+  cleanup_sender cleanup_() noexcept { return cleanup_sender{*this}; }
+
+  // The remaining members are only accessed on the I/O thread.
+
+  bool ready() const noexcept {
+    return ended_ || head_ != entries_.size();
+  }
+
+  entry pop() noexcept {
+    UNIFEX_ASSERT(head_ != entries_.size());
+    const entry e = entries_[head_++];
+    if (head_ == entries_.size()) {
+      entries_.clear();
+      head_ = 0;
+    }
+    return e;
+  }
+
+  void discard_all() noexcept {
+    for (; head_ != entries_.size(); ++head_) {
+      if (entries_[head_].result_ >= 0) {
+        io_.discard(entries_[head_].result_, entries_[head_].flags_);
+      }
+    }
+    entries_.clear();
+    head_ = 0;
+  }
+
+  std::uintptr_t user_data() noexcept {
+    return reinterpret_cast<std::uintptr_t>(
+               static_cast<multishot_base*>(this)) |
+        multishot_user_data_tag;
+  }
+
+  void submit() noexcept {
+    UNIFEX_ASSERT(state_ != state::submitted);
+    progressed_ = false;
+
+    auto populateSqe = [this](io_uring_sqe & sqe) noexcept {
+      io_.populate(sqe);
+      sqe.user_data = user_data();
+    };
+
+    if (context_.try_submit_io(populateSqe)) {
+      state_ = state::submitted;
+    } else {
+      state_ = state::pending;
+      this->execute_ = &multishot_stream::on_submit_pending;
+      queued_ = true;
+      context_.schedule_pending_io(this);
+    }
+  }
+
+  static void on_submit_pending(operation_base* op) noexcept {
+    auto& self = *static_cast<multishot_stream*>(op);
+    self.queued_ = false;
+    if (self.closing_) {
+      self.state_ = state::idle;
+      self.context_.schedule_local(std::exchange(self.cleanupWaiter_, nullptr));
+    } else {
+      self.submit();
+    }
+  }
+
+  void cancel() noexcept {
+    auto populateSqe = [this](io_uring_sqe & sqe) noexcept {
+      sqe.opcode = IORING_OP_ASYNC_CANCEL;
+      sqe.addr = user_data();
+      sqe.user_data = context_.cancel_user_data();
+    };
+
+    if (!context_.try_submit_unlimited_io(populateSqe)) {
+      this->execute_ = &multishot_stream::on_cancel_pending;
+      queued_ = true;
+      context_.schedule_pending_cancel(this);
+    }
+  }
+
+  static void on_cancel_pending(operation_base* op) noexcept {
+    auto& self = *static_cast<multishot_stream*>(op);
+    self.queued_ = false;
+    if (self.state_ == state::submitted) {
+      self.cancel();
+    } else {
+      // The request ended while the cancellation waited for space, and
+      // on_completion() left finishing the cleanup to us.
+      self.context_.schedule_local(std::exchange(self.cleanupWaiter_, nullptr));
+    }
+  }
+
+  // Called for every CQE of the request while the completion queue is being
+  // reaped.
+  static void
+  on_completion(multishot_base* op, int result, std::uint32_t flags) noexcept {
+    auto& self = *static_cast<multishot_stream*>(op);
+    const bool more = (flags & IORING_CQE_F_MORE) != 0;
+    if (!more) {
+      self.state_ = state::idle;
+    }
+
+    if (self.closing_) {
+      if (result >= 0) {
+        self.io_.discard(result, flags);
+      }
+      if (!more && !self.queued_) {
+        // Once cleanup completes the stream may be destroyed, so not while
+        // a deferred cancellation still links it into a pending queue.
+        self.context_.schedule_local(
+            std::exchange(self.cleanupWaiter_, nullptr));
+      }
+      return;
+    }
+
+    if (result < 0 && self.io_.is_retryable(result) &&
+        (self.progressed_ || !MultishotOp::retry_requires_progress)) {
+      // Try again straight away if the consumer is already waiting,
+      // otherwise once it asks for more.
+      if (!more && self.waiter_ != nullptr) {
+        self.submit();
+      }
+      return;
+    }
+
+    self.entries_.push_back(entry{result, flags});
+    if (result >= 0) {
+      self.progressed_ = true;
+      if (!more && !self.io_.is_end(result)) {
+        // The kernel ended the request, eg. because the completion queue
+        // overflowed.
+        self.submit();
+      }
+    }
+
+    if (self.waiter_ != nullptr) {
+      self.context_.schedule_local(std::exchange(self.waiter_, nullptr));
+    }
+  }
+
+  io_uring_context& context_;
+  MultishotOp io_;
+  std::vector<entry> entries_;
+  std::size_t head_ = 0;
+  state state_ = state::idle;
+  bool progressed_ = false;
+  bool ended_ = false;
+  bool closing_ = false;
+  // Whether the stream is in one of the context's pending queues, waiting to
+  // submit either the request or its cancellation.
+  bool queued_ = false;
+  operation_base* waiter_ = nullptr;
+  operation_base* cleanupWaiter_ = nullptr;
+};
+
+struct io_uring_context::read_op {
+  io_uring_context* context_;
+  // An index into the registered file table if 'fixedFile_' is true.
+  int fd_;
+  bool fixedFile_;
+  std::int64_t offset_;
+  iovec buffer_;
+  // Only set for files opened for direct I/O.
+  dio_alignment alignment_{};
+
+  void populate(io_uring_sqe& sqe) noexcept {
+    const int bufferIndex =
+        context_->find_registered_buffer(buffer_.iov_base, buffer_.iov_len);
+    if (bufferIndex >= 0) {
+      sqe.opcode = IORING_OP_READ_FIXED;
+      sqe.addr = reinterpret_cast<std::uintptr_t>(buffer_.iov_base);
+      sqe.len = static_cast<__u32>(buffer_.iov_len);
+      sqe.buf_index = static_cast<__u16>(bufferIndex);
+    } else {
+      sqe.opcode = IORING_OP_READV;
+      sqe.addr = reinterpret_cast<std::uintptr_t>(&buffer_);
+      sqe.len = 1;
+    }
+    sqe.fd = fd_;
+    if (fixedFile_) {
+      sqe.flags = IOSQE_FIXED_FILE;
+    }
+    sqe.off = offset_;
+  }
+
+  // Direct I/O that is not suitably aligned fails with EINVAL.
+  int validate() const noexcept {
+    return alignment_.is_aligned(buffer_.iov_base, offset_, buffer_.iov_len)
+        ? 0
+        : EINVAL;
+  }
+
+  // Produces number of bytes read.
+  ssize_t result(int res) const noexcept { return res; }
+};
+
+struct io_uring_context::write_op {
+  io_uring_context* context_;
+  // An index into the registered file table if 'fixedFile_' is true.
+  int fd_;
+  bool fixedFile_;
+  std::int64_t offset_;
+  iovec buffer_;
+  // Only set for files opened for direct I/O.
+  dio_alignment alignment_{};
+
+  void populate(io_uring_sqe& sqe) noexcept {
+    const int bufferIndex =
+        context_->find_registered_buffer(buffer_.iov_base, buffer_.iov_len);
+    if (bufferIndex >= 0) {
+      sqe.opcode = IORING_OP_WRITE_FIXED;
+      sqe.addr = reinterpret_cast<std::uintptr_t>(buffer_.iov_base);
+      sqe.len = static_cast<__u32>(buffer_.iov_len);
+      sqe.buf_index = static_cast<__u16>(bufferIndex);
+    } else {
+      sqe.opcode = IORING_OP_WRITEV;
+      sqe.addr = reinterpret_cast<std::uintptr_t>(&buffer_);
+      sqe.len = 1;
+    }
+    sqe.fd = fd_;
+    if (fixedFile_) {
+      sqe.flags = IOSQE_FIXED_FILE;
+    }
+    sqe.off = offset_;
+  }
+
+  // Direct I/O that is not suitably aligned fails with EINVAL.
+  int validate() const noexcept {
+    return alignment_.is_aligned(buffer_.iov_base, offset_, buffer_.iov_len)
+        ? 0
+        : EINVAL;
+  }
+
+  // Produces number of bytes written.
+  ssize_t result(int res) const noexcept { return res; }
+};
+
+// Reads into (Byte = std::byte) or writes from (Byte = const std::byte)
+// several buffers with a single IORING_OP_READV/WRITEV.
+template <typename Byte>
+struct io_uring_context::vectored_op {
+  // Up to this many iovecs are stored in the operation itself. More are
+  // allocated from the receiver's allocator.
+  static constexpr std::size_t inline_capacity = 4;
+
+  io_uring_context* context_;
+  // An index into the registered file table if 'fixedFile_' is true.
+  int fd_;
+  bool fixedFile_;
+  std::int64_t offset_;
+  span<const span<Byte>> buffers_;
+  // Only set for files opened for direct I/O.
+  dio_alignment alignment_{};
+  iovec inlineIovecs_[inline_capacity] = {};
+  iovec* iovecs_ = nullptr;
+
+  template <typename Allocator>
+  using iovec_allocator =
+      typename std::allocator_traits<Allocator>::template rebind_alloc<iovec>;
+
+  template <typename Allocator>
+  void prepare(const Allocator& allocator) {
+    if (buffers_.size() <= inline_capacity) {
+      iovecs_ = inlineIovecs_;
+    } else {
+      iovec_allocator<Allocator> iovecAllocator{allocator};
+      iovecs_ = std::allocator_traits<iovec_allocator<Allocator>>::allocate(
+          iovecAllocator, buffers_.size());
+    }
+    for (std::size_t i = 0; i < buffers_.size(); ++i) {
+      iovecs_[i].iov_base = const_cast<std::byte*>(buffers_[i].data());
+      iovecs_[i].iov_len = buffers_[i].size();
+    }
+  }
+
+  template <typename Allocator>
+  void release(const Allocator& allocator) noexcept {
+    if (iovecs_ != nullptr && iovecs_ != inlineIovecs_) {
+      iovec_allocator<Allocator> iovecAllocator{allocator};
+      std::allocator_traits<iovec_allocator<Allocator>>::deallocate(
+          iovecAllocator, iovecs_, buffers_.size());
+    }
+    iovecs_ = nullptr;
+  }
+
+  // The kernel rejects more than IOV_MAX buffers, and direct I/O that is not
+  // suitably aligned, with EINVAL.
+  int validate() const noexcept {
+    if (buffers_.size() > static_cast<std::size_t>(IOV_MAX)) {
+      return EINVAL;
+    }
+    for (const auto& buffer : buffers_) {
+      if (!alignment_.is_aligned(buffer.data(), offset_, buffer.size())) {
+        return EINVAL;
+      }
+    }
+    return 0;
+  }
+
+  void populate(io_uring_sqe& sqe) noexcept {
+    sqe.opcode =
+        std::is_const_v<Byte> ? IORING_OP_WRITEV : IORING_OP_READV;
+    sqe.addr = reinterpret_cast<std::uintptr_t>(iovecs_);
+    sqe.len = static_cast<__u32>(buffers_.size());
+    sqe.fd = fd_;
+    if (fixedFile_) {
+      sqe.flags = IOSQE_FIXED_FILE;
+    }
+    sqe.off = offset_;
+  }
+
+  // Produces number of bytes read or written, filling the buffers in order.
+  ssize_t result(int res) const noexcept { return res; }
+};
+
+struct io_uring_context::recv_op {
+  int fd_;
+  span<std::byte> buffer_;
+  int flags_;
+
+  void populate(io_uring_sqe& sqe) noexcept {
+    sqe.opcode = IORING_OP_RECV;
+    sqe.fd = fd_;
+    sqe.addr = reinterpret_cast<std::uintptr_t>(buffer_.data());
+    sqe.len = static_cast<std::uint32_t>(buffer_.size());
+    sqe.msg_flags = static_cast<std::uint32_t>(flags_);
+  }
+
+  // Produces the number of bytes received, zero once the peer has shut
+  // down its end of the connection.
+  ssize_t result(int res) const noexcept { return res; }
+};
+
+struct io_uring_context::send_op {
+  int fd_;
+  span<const std::byte> buffer_;
+  int flags_;
+
+  void populate(io_uring_sqe& sqe) noexcept {
+    sqe.opcode = IORING_OP_SEND;
+    sqe.fd = fd_;
+    sqe.addr = reinterpret_cast<std::uintptr_t>(buffer_.data());
+    sqe.len = static_cast<std::uint32_t>(buffer_.size());
+    sqe.msg_flags = static_cast<std::uint32_t>(flags_);
+  }
+
+  ssize_t result(int res) const noexcept { return res; }
+};
+
+struct io_uring_context::recv_msg_op {
+  int fd_;
+  msghdr* message_;
+  int flags_;
+
+  void populate(io_uring_sqe& sqe) noexcept {
+    sqe.opcode = IORING_OP_RECVMSG;
+    sqe.fd = fd_;
+    sqe.addr = reinterpret_cast<std::uintptr_t>(message_);
+    sqe.len = 1;
+    sqe.msg_flags = static_cast<std::uint32_t>(flags_);
+  }
+
+  ssize_t result(int res) const noexcept { return res; }
+};
+
+struct io_uring_context::send_msg_op {
+  int fd_;
+  const msghdr* message_;
+  int flags_;
+
+  void populate(io_uring_sqe& sqe) noexcept {
+    sqe.opcode = IORING_OP_SENDMSG;
+    sqe.fd = fd_;
+    sqe.addr = reinterpret_cast<std::uintptr_t>(message_);
+    sqe.len = 1;
+    sqe.msg_flags = static_cast<std::uint32_t>(flags_);
+  }
+
+  ssize_t result(int res) const noexcept { return res; }
+};
+
+struct io_uring_context::connect_op {
+  int fd_;
+  // A copy of the address so that the caller's needn't outlive the
+  // operation.
+  sockaddr_storage address_;
+  socklen_t addressLength_;
+
+  void populate(io_uring_sqe& sqe) noexcept {
+    sqe.opcode = IORING_OP_CONNECT;
+    sqe.fd = fd_;
+    sqe.addr = reinterpret_cast<std::uintptr_t>(&address_);
+    sqe.off = addressLength_;
+  }
+
+  void result(int) const noexcept {}
+};
+
+struct io_uring_context::accept_op {
+  io_uring_context* context_;
+  int fd_;
+
+  void populate(io_uring_sqe& sqe) noexcept {
+    sqe.opcode = IORING_OP_ACCEPT;
+    sqe.fd = fd_;
+    sqe.accept_flags = SOCK_CLOEXEC;
+  }
+
+  // Produces the accepted connection.
+  async_socket result(int res) const noexcept;
+};
+
+struct io_uring_context::accept_multishot_op {
+  io_uring_context* context_;
+  int fd_;
+
+  void populate(io_uring_sqe& sqe) noexcept {
+    sqe.opcode = IORING_OP_ACCEPT;
+    sqe.fd = fd_;
+    sqe.ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe.accept_flags = SOCK_CLOEXEC;
+  }
+
+  // Produces the accepted connection.
+  async_socket result(int res, std::uint32_t flags) const noexcept;
+
+  // Closes a connection that was never consumed.
+  void discard(int res, std::uint32_t) const noexcept {
+    safe_file_descriptor{res}.close();
+  }
+
+  static bool is_end(int) noexcept { return false; }
+
+  // The connection was reset before it could be accepted. Says nothing
+  // about the next one, so always try again.
+  static bool is_retryable(int res) noexcept {
+    return res == -ECONNABORTED || res == -EINTR;
+  }
+  static constexpr bool retry_requires_progress = false;
+};
+
+template <typename File>
+struct io_uring_context::open_op {
+  io_uring_context* context_;
+  // A copy of the path so that the caller's needn't outlive the operation.
+  filesystem::path path_;
+  int flags_;
+  mode_t mode_;
+
+  void populate(io_uring_sqe& sqe) noexcept {
+    sqe.opcode = IORING_OP_OPENAT;
+    sqe.fd = AT_FDCWD;
+    sqe.addr = reinterpret_cast<std::uintptr_t>(path_.c_str());
+    sqe.len = mode_;
+    sqe.open_flags = static_cast<std::uint32_t>(flags_ | O_CLOEXEC);
+  }
+
+  // Produces the opened file.
+  File result(int res) const noexcept {
+    return File{*context_, res, (flags_ & O_DIRECT) != 0};
+  }
+};
+
+struct io_uring_context::close_op {
+  safe_file_descriptor* fd_;
+  file_slot* slot_;
+
+  void populate(io_uring_sqe& sqe) noexcept {
+    // The file table holds its own reference to the file so release the
+    // slot too, otherwise the file would stay open until it is destroyed.
+    *slot_ = file_slot{};
+    sqe.opcode = IORING_OP_CLOSE;
+    sqe.fd = fd_->release();
+  }
+
+  void result(int) const noexcept {}
+};
+
+struct io_uring_context::fsync_op {
+  int fd_;
+  bool fixedFile_;
+  // Either zero or IORING_FSYNC_DATASYNC.
+  std::uint32_t flags_;
+
+  void populate(io_uring_sqe& sqe) noexcept {
+    sqe.opcode = IORING_OP_FSYNC;
+    sqe.fd = fd_;
+    sqe.fsync_flags = flags_;
+    if (fixedFile_) {
+      sqe.flags |= IOSQE_FIXED_FILE;
+    }
+  }
+
+  void result(int) const noexcept {}
+};
+
+struct io_uring_context::fallocate_op {
+  int fd_;
+  bool fixedFile_;
+  int mode_;
+  std::int64_t offset_;
+  std::int64_t length_;
+
+  void populate(io_uring_sqe& sqe) noexcept {
+    sqe.opcode = IORING_OP_FALLOCATE;
+    sqe.fd = fd_;
+    sqe.addr = static_cast<std::uint64_t>(length_);
+    sqe.len = static_cast<std::uint32_t>(mode_);
+    sqe.off = static_cast<std::uint64_t>(offset_);
+    if (fixedFile_) {
+      sqe.flags |= IOSQE_FIXED_FILE;
+    }
+  }
+
+  void result(int) const noexcept {}
+};
+
+struct io_uring_context::statx_op {
+  // Always a real descriptor: IORING_OP_STATX does not take fixed files.
+  int fd_;
+  unsigned int mask_;
+  struct statx buffer_;
+
+  void populate(io_uring_sqe& sqe) noexcept {
+    sqe.opcode = IORING_OP_STATX;
+    sqe.fd = fd_;
+    sqe.addr = reinterpret_cast<std::uintptr_t>("");
+    sqe.len = mask_;
+    sqe.off = reinterpret_cast<std::uintptr_t>(&buffer_);
+    sqe.statx_flags = AT_EMPTY_PATH;
+  }
+
+  // Produces the attributes filled in by the kernel.
+  struct statx result(int) const noexcept { return buffer_; }
+};
+
+struct io_uring_context::splice_op {
+  splice_end in_;
+  // -1 for a pipe or socket.
+  std::int64_t inOffset_;
+  splice_end out_;
+  std::int64_t outOffset_;
+  std::uint32_t length_;
+
+  void populate(io_uring_sqe& sqe) noexcept {
+    sqe.opcode = IORING_OP_SPLICE;
+    sqe.splice_fd_in = in_.fd_;
+    sqe.splice_off_in = static_cast<std::uint64_t>(inOffset_);
+    sqe.fd = out_.fd_;
+    sqe.off = static_cast<std::uint64_t>(outOffset_);
+    sqe.len = length_;
+    if (in_.fixedFile_) {
+      sqe.splice_flags = SPLICE_F_FD_IN_FIXED;
+    }
+    if (out_.fixedFile_) {
+      sqe.flags |= IOSQE_FIXED_FILE;
+    }
+  }
+
+  // Produces the number of bytes moved, zero at the end of the input.
+  ssize_t result(int res) const noexcept { return res; }
+};
+
+struct io_uring_context::tee_op {
+  int in_;
+  int out_;
+  std::uint32_t length_;
+
+  void populate(io_uring_sqe& sqe) noexcept {
+    sqe.opcode = IORING_OP_TEE;
+    sqe.splice_fd_in = in_;
+    sqe.fd = out_;
+    sqe.len = length_;
+  }
+
+  // Produces the number of bytes copied.
+  ssize_t result(int res) const noexcept { return res; }
+};
+
+// The state and operations shared by every file type.
+class io_uring_context::file_base {
+ public:
+  using offset_t = std::int64_t;
+
+  // The alignment that the buffers, offsets and lengths of reads and writes
+  // must have, or zero if the file was not opened for direct I/O.
+  std::size_t direct_io_alignment() const noexcept {
+    return std::max(alignment_.memory_, alignment_.offset_);
+  }
+
+ protected:
+  explicit file_base(io_uring_context& context, int fd, bool direct) noexcept
+      : context_(context),
+        fd_(fd),
+        slot_(context.try_register_file(fd)),
+        alignment_(direct ? query_dio_alignment(fd) : dio_alignment{}) {}
+
+  // The registered file slot if there is one, otherwise the descriptor.
+  int io_fd() const noexcept {
+    return slot_.index() >= 0 ? slot_.index() : fd_.get();
+  }
+
+  splice_end splice_end_() const noexcept {
+    return splice_end{&context_, io_fd(), slot_.index() >= 0};
+  }
+
+  io_uring_context& context_;
+  safe_file_descriptor fd_;
+  file_slot slot_;
+  dio_alignment alignment_;
+
+ private:
+  friend io_uring_context;
+
+  close_sender close_() noexcept {
+    return close_sender{context_, close_op{&fd_, &slot_}};
   }
 
- private:
-  io_uring_context& context_;
-  int fd_;
-  offset_t offset_;
-  span<const std::byte> buffer_;
+  fsync_sender fsync_(std::uint32_t flags) noexcept {
+    return fsync_sender{
+        context_, fsync_op{io_fd(), slot_.index() >= 0, flags}};
+  }
+
+  fallocate_sender
+  fallocate_(int mode, offset_t offset, offset_t length) noexcept {
+    return fallocate_sender{
+        context_,
+        fallocate_op{io_fd(), slot_.index() >= 0, mode, offset, length}};
+  }
+
+  statx_sender statx_(unsigned int mask) noexcept {
+    return statx_sender{context_, statx_op{fd_.get(), mask, {}}};
+  }
+
+  friend close_sender
+  tag_invoke(tag_t<async_close>, file_base& file) noexcept {
+    return file.close_();
+  }
+
+  friend fsync_sender
+  tag_invoke(tag_t<async_fsync>, file_base& file) noexcept {
+    return file.fsync_(0);
+  }
+
+  friend fsync_sender
+  tag_invoke(tag_t<async_fdatasync>, file_base& file) noexcept {
+    return file.fsync_(IORING_FSYNC_DATASYNC);
+  }
+
+  friend fallocate_sender tag_invoke(
+      tag_t<async_fallocate>,
+      file_base& file,
+      int mode,
+      offset_t offset,
+      offset_t length) noexcept {
+    return file.fallocate_(mode, offset, length);
+  }
+
+  friend statx_sender tag_invoke(
+      tag_t<async_statx>, file_base& file, unsigned int mask) noexcept {
+    return file.statx_(mask);
+  }
 };
 
-class io_uring_context::async_read_only_file {
+class io_uring_context::async_read_only_file : public file_base {
  public:
-  using offset_t = std::int64_t;
-
-  explicit async_read_only_file(io_uring_context& context, int fd) noexcept
-      : context_(context), fd_(fd) {}
+  // 'direct' is true if 'fd' was opened with O_DIRECT.
+  explicit async_read_only_file(
+      io_uring_context& context, int fd, bool direct = false) noexcept
+      : file_base(context, fd, direct) {}
 
  private:
   friend scheduler;
 
+  read_sender read_(offset_t offset, span<std::byte> buffer) noexcept {
+    return read_sender{
+        context_,
+        read_op{
+            &context_,
+            io_fd(),
+            slot_.index() >= 0,
+            offset,
+            iovec{buffer.data(), buffer.size()},
+            alignment_}};
+  }
+
+  readv_sender
+  readv_(offset_t offset, span<const span<std::byte>> buffers) noexcept {
+    return readv_sender{
+        context_,
+        vectored_op<std::byte>{
+            &context_,
+            io_fd(),
+            slot_.index() >= 0,
+            offset,
+            buffers,
+            alignment_}};
+  }
+
   friend read_sender tag_invoke(
       tag_t<async_read_some_at>,
       async_read_only_file& file,
       offset_t offset,
       span<std::byte> buffer) noexcept {
-    return read_sender{file.context_, file.fd_.get(), offset, buffer};
+    return file.read_(offset, buffer);
   }
 
-  io_uring_context& context_;
-  safe_file_descriptor fd_;
+  // Scatters the data read over 'buffers', in order.
+  friend readv_sender tag_invoke(
+      tag_t<async_read_some_at>,
+      async_read_only_file& file,
+      offset_t offset,
+      span<const span<std::byte>> buffers) noexcept {
+    return file.readv_(offset, buffers);
+  }
 };
 
-class io_uring_context::async_write_only_file {
+class io_uring_context::async_write_only_file : public file_base {
  public:
-  using offset_t = std::int64_t;
-
-  explicit async_write_only_file(io_uring_context& context, int fd) noexcept
-      : context_(context), fd_(fd) {}
+  // 'direct' is true if 'fd' was opened with O_DIRECT.
+  explicit async_write_only_file(
+      io_uring_context& context, int fd, bool direct = false) noexcept
+      : file_base(context, fd, direct) {}
 
  private:
   friend scheduler;
 
+  write_sender write_(offset_t offset, span<const std::byte> buffer) noexcept {
+    return write_sender{
+        context_,
+        write_op{
+            &context_,
+            io_fd(),
+            slot_.index() >= 0,
+            offset,
+            iovec{const_cast<std::byte*>(buffer.data()), buffer.size()},
+            alignment_}};
+  }
+
+  writev_sender writev_(
+      offset_t offset, span<const span<const std::byte>> buffers) noexcept {
+    return writev_sender{
+        context_,
+        vectored_op<const std::byte>{
+            &context_,
+            io_fd(),
+            slot_.index() >= 0,
+            offset,
+            buffers,
+            alignment_}};
+  }
+
   friend write_sender tag_invoke(
       tag_t<async_write_some_at>,
       async_write_only_file& file,
       offset_t offset,
       span<const std::byte> buffer) noexcept {
-    return write_sender{file.context_, file.fd_.get(), offset, buffer};
+    return file.write_(offset, buffer);
   }
 
-  io_uring_context& context_;
-  safe_file_descriptor fd_;
+  // Gathers the data written from 'buffers', in order.
+  friend writev_sender tag_invoke(
+      tag_t<async_write_some_at>,
+      async_write_only_file& file,
+      offset_t offset,
+      span<const span<const std::byte>> buffers) noexcept {
+    return file.writev_(offset, buffers);
+  }
 };
 
-class io_uring_context::async_read_write_file {
+class io_uring_context::async_read_write_file : public file_base {
  public:
-  using offset_t = std::int64_t;
-
-  explicit async_read_write_file(io_uring_context& context, int fd) noexcept
-      : context_(context), fd_(fd) {}
+  // 'direct' is true if 'fd' was opened with O_DIRECT.
+  explicit async_read_write_file(
+      io_uring_context& context, int fd, bool direct = false) noexcept
+      : file_base(context, fd, direct) {}
 
  private:
   friend scheduler;
 
+  read_sender read_(offset_t offset, span<std::byte> buffer) noexcept {
+    return read_sender{
+        context_,
+        read_op{
+            &context_,
+            io_fd(),
+            slot_.index() >= 0,
+            offset,
+            iovec{buffer.data(), buffer.size()},
+            alignment_}};
+  }
+
+  readv_sender
+  readv_(offset_t offset, span<const span<std::byte>> buffers) noexcept {
+    return readv_sender{
+        context_,
+        vectored_op<std::byte>{
+            &context_,
+            io_fd(),
+            slot_.index() >= 0,
+            offset,
+            buffers,
+            alignment_}};
+  }
+
+  write_sender write_(offset_t offset, span<const std::byte> buffer) noexcept {
+    return write_sender{
+        context_,
+        write_op{
+            &context_,
+            io_fd(),
+            slot_.index() >= 0,
+            offset,
+            iovec{const_cast<std::byte*>(buffer.data()), buffer.size()},
+            alignment_}};
+  }
+
+  writev_sender writev_(
+      offset_t offset, span<const span<const std::byte>> buffers) noexcept {
+    return writev_sender{
+        context_,
+        vectored_op<const std::byte>{
+            &context_,
+            io_fd(),
+            slot_.index() >= 0,
+            offset,
+            buffers,
+            alignment_}};
+  }
+
   friend write_sender tag_invoke(
       tag_t<async_write_some_at>,
       async_read_write_file& file,
       offset_t offset,
       span<const std::byte> buffer) noexcept {
-    return write_sender{file.context_, file.fd_.get(), offset, buffer};
+    return file.write_(offset, buffer);
+  }
+
+  // Gathers the data written from 'buffers', in order.
+  friend writev_sender tag_invoke(
+      tag_t<async_write_some_at>,
+      async_read_write_file& file,
+      offset_t offset,
+      span<const span<const std::byte>> buffers) noexcept {
+    return file.writev_(offset, buffers);
   }
 
   friend read_sender tag_invoke(
@@ -692,13 +2921,483 @@ class io_uring_context::async_read_write_file {
       async_read_write_file& file,
       offset_t offset,
       span<std::byte> buffer) noexcept {
-    return read_sender{file.context_, file.fd_.get(), offset, buffer};
+    return file.read_(offset, buffer);
+  }
+
+  // Scatters the data read over 'buffers', in order.
+  friend readv_sender tag_invoke(
+      tag_t<async_read_some_at>,
+      async_read_write_file& file,
+      offset_t offset,
+      span<const span<std::byte>> buffers) noexcept {
+    return file.readv_(offset, buffers);
+  }
+};
+
+// A ring of equally sized buffers that the kernel picks from as data arrives
+// (IORING_REGISTER_PBUF_RING), so that a receive only ties up a buffer once
+// there is something to receive. Many connections can share one ring, which
+// keeps the memory used proportional to the traffic rather than to the
+// number of connections.
+//
+// Received buffers are handed out as leases that put the buffer back in the
+// ring when they are released. Leases may be released on any thread.
+class io_uring_context::provided_buffer_ring {
+ public:
+  class lease;
+
+  // Allocates bufferCount buffers of bufferSize bytes each and registers
+  // them with 'context' as a new buffer group. bufferCount must be a power of
+  // two no greater than 32768.
+  explicit provided_buffer_ring(
+      io_uring_context& context,
+      std::size_t bufferSize,
+      std::uint16_t bufferCount);
+
+  provided_buffer_ring(const provided_buffer_ring&) = delete;
+  provided_buffer_ring& operator=(const provided_buffer_ring&) = delete;
+
+  // All leases must have been released and no request may be using the
+  // ring.
+  ~provided_buffer_ring();
+
+  std::uint16_t group_id() const noexcept { return groupId_; }
+
+  std::size_t buffer_size() const noexcept { return bufferSize_; }
+
+  std::uint16_t buffer_count() const noexcept { return bufferCount_; }
+
+ private:
+  friend recv_multishot_op;
+
+  std::byte* buffer(std::uint16_t id) const noexcept {
+    return buffers_ + std::size_t{id} * bufferSize_;
+  }
+
+  // Gives the buffer back to the kernel.
+  void recycle(std::uint16_t id) noexcept;
+
+  io_uring_context& context_;
+  std::size_t bufferSize_;
+  std::uint16_t bufferCount_;
+  std::uint16_t groupId_;
+  // The ring entries followed by the buffers.
+  mmap_region region_;
+  io_uring_buf_ring* ring_;
+  std::byte* buffers_;
+  std::mutex mutex_;
+  std::uint16_t tail_ = 0;
+};
+
+// A buffer that the kernel received data into, which goes back to its ring
+// on release() or destruction.
+class io_uring_context::provided_buffer_ring::lease {
+ public:
+  lease() noexcept = default;
+
+  lease(lease&& other) noexcept
+    : ring_(std::exchange(other.ring_, nullptr)),
+      id_(other.id_),
+      size_(other.size_) {}
+
+  ~lease() { release(); }
+
+  lease& operator=(lease other) noexcept {
+    std::swap(ring_, other.ring_);
+    std::swap(id_, other.id_);
+    std::swap(size_, other.size_);
+    return *this;
+  }
+
+  // The received bytes.
+  span<std::byte> data() const noexcept {
+    return ring_ != nullptr ? span{ring_->buffer(id_), size_}
+                            : span<std::byte>{};
+  }
+
+  void release() noexcept {
+    if (ring_ != nullptr) {
+      std::exchange(ring_, nullptr)->recycle(id_);
+    }
+  }
+
+ private:
+  friend recv_multishot_op;
+
+  explicit lease(
+      provided_buffer_ring& ring, std::uint16_t id, std::size_t size) noexcept
+    : ring_(&ring), id_(id), size_(size) {}
+
+  provided_buffer_ring* ring_ = nullptr;
+  std::uint16_t id_ = 0;
+  std::size_t size_ = 0;
+};
+
+struct io_uring_context::recv_multishot_op {
+  int fd_;
+  provided_buffer_ring* buffers_;
+
+  void populate(io_uring_sqe& sqe) noexcept {
+    sqe.opcode = IORING_OP_RECV;
+    sqe.fd = fd_;
+    sqe.ioprio = IORING_RECV_MULTISHOT;
+    sqe.flags |= IOSQE_BUFFER_SELECT;
+    sqe.buf_group = buffers_->group_id();
+  }
+
+  // Produces the buffer the kernel picked for the data.
+  provided_buffer_ring::lease result(int res, std::uint32_t flags) noexcept {
+    return provided_buffer_ring::lease{
+        *buffers_,
+        static_cast<std::uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT),
+        static_cast<std::size_t>(res)};
+  }
+
+  void discard(int, std::uint32_t flags) noexcept {
+    if ((flags & IORING_CQE_F_BUFFER) != 0) {
+      buffers_->recycle(
+          static_cast<std::uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT));
+    }
+  }
+
+  // The peer has shut down its end of the connection.
+  static bool is_end(int res) noexcept { return res == 0; }
+
+  // The ring ran out of buffers. Wait for the consumer to release some,
+  // unless it has none to release.
+  static bool is_retryable(int res) noexcept { return res == -ENOBUFS; }
+  static constexpr bool retry_requires_progress = true;
+};
+
+// A stream socket whose I/O is performed by the io_uring_context.
+//
+// Use async_read_some() and async_write_some() to receive and send, which
+// complete with the number of bytes transferred.
+class io_uring_context::async_socket {
+ public:
+  explicit async_socket(io_uring_context& context, int fd) noexcept
+      : context_(context), fd_(fd) {}
+
+  // For binding, listening and setting socket options.
+  int native_handle() const noexcept { return fd_.get(); }
+
+ private:
+  friend io_uring_context;
+  friend scheduler;
+
+  splice_end splice_end_() const noexcept {
+    return splice_end{&context_, fd_.get(), false};
+  }
+
+  recv_sender recv_(span<std::byte> buffer, int flags) noexcept {
+    return recv_sender{context_, recv_op{fd_.get(), buffer, flags}};
+  }
+
+  send_sender send_(span<const std::byte> buffer, int flags) noexcept {
+    return send_sender{context_, send_op{fd_.get(), buffer, flags}};
+  }
+
+  recv_msg_sender recv_msg_(msghdr* message, int flags) noexcept {
+    return recv_msg_sender{context_, recv_msg_op{fd_.get(), message, flags}};
+  }
+
+  send_msg_sender send_msg_(const msghdr* message, int flags) noexcept {
+    return send_msg_sender{context_, send_msg_op{fd_.get(), message, flags}};
+  }
+
+  accept_sender accept_() noexcept {
+    return accept_sender{context_, accept_op{&context_, fd_.get()}};
+  }
+
+  recv_multishot_stream
+  recv_stream_(provided_buffer_ring& buffers) noexcept {
+    return recv_multishot_stream{
+        context_, recv_multishot_op{fd_.get(), &buffers}};
+  }
+
+  accept_multishot_stream accept_stream_() noexcept {
+    return accept_multishot_stream{
+        context_, accept_multishot_op{&context_, fd_.get()}};
+  }
+
+  connect_sender
+  connect_(const sockaddr* address, socklen_t addressLength) noexcept {
+    connect_op op{fd_.get(), {}, addressLength};
+    UNIFEX_ASSERT(addressLength <= sizeof(op.address_));
+    std::memcpy(&op.address_, address, addressLength);
+    return connect_sender{context_, op};
+  }
+
+  friend recv_sender tag_invoke(
+      tag_t<async_read_some>,
+      async_socket& socket,
+      span<std::byte> buffer) noexcept {
+    return socket.recv_(buffer, 0);
+  }
+
+  friend send_sender tag_invoke(
+      tag_t<async_write_some>,
+      async_socket& socket,
+      span<const std::byte> buffer) noexcept {
+    // Report a closed connection as EPIPE rather than raising SIGPIPE.
+    return socket.send_(buffer, MSG_NOSIGNAL);
+  }
+
+  friend recv_msg_sender tag_invoke(
+      tag_t<async_recv_msg>,
+      async_socket& socket,
+      msghdr* message,
+      int flags = 0) noexcept {
+    return socket.recv_msg_(message, flags);
+  }
+
+  friend send_msg_sender tag_invoke(
+      tag_t<async_send_msg>,
+      async_socket& socket,
+      const msghdr* message,
+      int flags = MSG_NOSIGNAL) noexcept {
+    return socket.send_msg_(message, flags);
+  }
+
+  friend accept_sender
+  tag_invoke(tag_t<async_accept>, async_socket& socket) noexcept {
+    return socket.accept_();
+  }
+
+  friend recv_multishot_stream tag_invoke(
+      tag_t<recv_stream>,
+      async_socket& socket,
+      provided_buffer_ring& buffers) noexcept {
+    return socket.recv_stream_(buffers);
+  }
+
+  friend accept_multishot_stream
+  tag_invoke(tag_t<accept_stream>, async_socket& socket) noexcept {
+    return socket.accept_stream_();
+  }
+
+  friend connect_sender tag_invoke(
+      tag_t<async_connect>,
+      async_socket& socket,
+      const sockaddr* address,
+      socklen_t addressLength) noexcept {
+    return socket.connect_(address, addressLength);
+  }
+
+  io_uring_context& context_;
+  safe_file_descriptor fd_;
+};
+
+// The read end of a pipe.
+class io_uring_context::async_reader {
+ public:
+  explicit async_reader(io_uring_context& context, int fd) noexcept
+      : context_(context), fd_(fd) {}
+
+  int native_handle() const noexcept { return fd_.get(); }
+
+ private:
+  friend io_uring_context;
+  friend scheduler;
+
+  splice_end splice_end_() const noexcept {
+    return splice_end{&context_, fd_.get(), false};
+  }
+
+  read_sender read_(span<std::byte> buffer) noexcept {
+    return read_sender{
+        context_,
+        read_op{
+            &context_,
+            fd_.get(),
+            false,
+            -1,
+            iovec{buffer.data(), buffer.size()}}};
+  }
+
+  friend read_sender tag_invoke(
+      tag_t<async_read_some>,
+      async_reader& reader,
+      span<std::byte> buffer) noexcept {
+    return reader.read_(buffer);
+  }
+
+  io_uring_context& context_;
+  safe_file_descriptor fd_;
+};
+
+// The write end of a pipe.
+class io_uring_context::async_writer {
+ public:
+  explicit async_writer(io_uring_context& context, int fd) noexcept
+      : context_(context), fd_(fd) {}
+
+  int native_handle() const noexcept { return fd_.get(); }
+
+ private:
+  friend io_uring_context;
+  friend scheduler;
+
+  splice_end splice_end_() const noexcept {
+    return splice_end{&context_, fd_.get(), false};
+  }
+
+  write_sender write_(span<const std::byte> buffer) noexcept {
+    return write_sender{
+        context_,
+        write_op{
+            &context_,
+            fd_.get(),
+            false,
+            -1,
+            iovec{const_cast<std::byte*>(buffer.data()), buffer.size()}}};
+  }
+
+  friend write_sender tag_invoke(
+      tag_t<async_write_some>,
+      async_writer& writer,
+      span<const std::byte> buffer) noexcept {
+    return writer.write_(buffer);
   }
 
   io_uring_context& context_;
   safe_file_descriptor fd_;
 };
 
+template <typename Source, typename Destination>
+auto io_uring_context::splice_(
+    Source& source,
+    std::int64_t sourceOffset,
+    Destination& destination,
+    std::int64_t destinationOffset,
+    std::size_t length) noexcept
+    -> decltype(
+        source.splice_end_(),
+        destination.splice_end_(),
+        UNIFEX_DECLVAL(splice_sender)) {
+  const splice_end in = source.splice_end_();
+  const splice_end out = destination.splice_end_();
+  UNIFEX_ASSERT(in.context_ == out.context_);
+  return splice_sender{
+      *in.context_,
+      splice_op{
+          in,
+          sourceOffset,
+          out,
+          destinationOffset,
+          static_cast<std::uint32_t>(
+              std::min<std::size_t>(length, UINT32_MAX))}};
+}
+
+inline io_uring_context::tee_sender io_uring_context::tee_(
+    async_reader& source,
+    async_writer& destination,
+    std::size_t length) noexcept {
+  const splice_end in = source.splice_end_();
+  const splice_end out = destination.splice_end_();
+  UNIFEX_ASSERT(in.context_ == out.context_);
+  return tee_sender{
+      *in.context_,
+      tee_op{
+          in.fd_,
+          out.fd_,
+          static_cast<std::uint32_t>(
+              std::min<std::size_t>(length, UINT32_MAX))}};
+}
+
+inline io_uring_context::tee_sender tag_invoke(
+    tag_t<async_tee>,
+    io_uring_context::async_reader& source,
+    io_uring_context::async_writer& destination,
+    std::size_t length) noexcept {
+  return io_uring_context::tee_(source, destination, length);
+}
+
+inline io_uring_context::async_socket
+io_uring_context::accept_op::result(int res) const noexcept {
+  return async_socket{*context_, res};
+}
+
+inline io_uring_context::async_socket
+io_uring_context::accept_multishot_op::result(
+    int res, std::uint32_t) const noexcept {
+  return async_socket{*context_, res};
+}
+
+// A pool of equally sized buffers carved out of a single region of memory,
+// each of which starts at a multiple of the pool's alignment and spans a
+// multiple of it.
+//
+// Created with the direct_io_alignment() of a file, any slice of a buffer
+// that starts and ends at a multiple of the alignment can be used for direct
+// I/O on the file.
+//
+// allocate() and deallocate() may be called from any thread.
+class io_uring_context::aligned_buffer_pool {
+ public:
+  // Allocates bufferCount buffers of bufferSize bytes each, rounded up to a
+  // multiple of 'alignment'. The alignment must be a power of two no larger
+  // than the page size.
+  explicit aligned_buffer_pool(
+      std::size_t bufferSize,
+      std::size_t bufferCount,
+      std::size_t alignment);
+
+  aligned_buffer_pool(const aligned_buffer_pool&) = delete;
+  aligned_buffer_pool& operator=(const aligned_buffer_pool&) = delete;
+
+  // All buffers must have been returned to the pool.
+  ~aligned_buffer_pool();
+
+  // Returns an empty span if all buffers are in use.
+  span<std::byte> allocate() noexcept;
+
+  void deallocate(span<std::byte> buffer) noexcept;
+
+  std::size_t buffer_size() const noexcept { return bufferSize_; }
+
+  std::size_t buffer_count() const noexcept { return bufferCount_; }
+
+  std::size_t alignment() const noexcept { return alignment_; }
+
+ protected:
+  // The memory that the buffers are carved out of.
+  const mmap_region& region() const noexcept { return region_; }
+
+ private:
+  std::size_t alignment_;
+  std::size_t bufferSize_;
+  std::size_t bufferCount_;
+  mmap_region region_;
+  std::mutex mutex_;
+  std::vector<std::size_t> freeBuffers_;
+};
+
+// An aligned_buffer_pool that is registered with the io_uring_context for the
+// lifetime of the pool.
+//
+// Reads and writes into buffers obtained from allocate() are submitted as
+// IORING_OP_READ_FIXED/WRITE_FIXED, avoiding the cost of pinning and
+// unpinning the pages on every request.
+class io_uring_context::registered_buffer_pool : public aligned_buffer_pool {
+ public:
+  // Allocates bufferCount buffers of bufferSize bytes each and registers them
+  // with 'context'. Buffers are page-aligned if bufferSize is a multiple of
+  // the page size.
+  explicit registered_buffer_pool(
+      io_uring_context& context,
+      std::size_t bufferSize,
+      std::size_t bufferCount,
+      std::size_t alignment = 1);
+
+  // All buffers must have been returned to the pool and no I/O may be
+  // outstanding on them.
+  ~registered_buffer_pool();
+
+ private:
+  io_uring_context& context_;
+};
+
 class io_uring_context::schedule_at_sender {
   template <typename Receiver>
   struct operation : schedule_at_operation {
@@ -910,6 +3609,11 @@ class io_uring_context::scheduler {
     return schedule_at_sender{*context_, dueTime};
   }
 
+  // See capacity_sender.
+  capacity_sender wait_for_capacity() const noexcept {
+    return capacity_sender{*context_};
+  }
+
  private:
   friend io_uring_context;
 
@@ -925,6 +3629,84 @@ class io_uring_context::scheduler {
       tag_t<open_file_write_only>,
       scheduler s,
       const filesystem::path& path);
+  friend async_read_only_file tag_invoke(
+      tag_t<open_file_read_only>,
+      scheduler s,
+      const filesystem::path& path,
+      const open_file_options& options);
+  friend async_read_write_file tag_invoke(
+      tag_t<open_file_read_write>,
+      scheduler s,
+      const filesystem::path& path,
+      const open_file_options& options);
+  friend async_write_only_file tag_invoke(
+      tag_t<open_file_write_only>,
+      scheduler s,
+      const filesystem::path& path,
+      const open_file_options& options);
+
+  // The flags to open a file with in addition to its access mode.
+  static int open_flags(const open_file_options& options) noexcept {
+    return options.direct ? O_DIRECT : 0;
+  }
+
+  template <typename File>
+  open_sender<File>
+  open_(const filesystem::path& path, int flags, mode_t mode) const {
+    return open_sender<File>{
+        *context_, open_op<File>{context_, path, flags, mode}};
+  }
+
+  friend open_sender<async_read_only_file> tag_invoke(
+      tag_t<async_open_file_read_only>,
+      scheduler s,
+      const filesystem::path& path) {
+    return s.open_<async_read_only_file>(path, O_RDONLY, 0);
+  }
+  friend open_sender<async_read_write_file> tag_invoke(
+      tag_t<async_open_file_read_write>,
+      scheduler s,
+      const filesystem::path& path) {
+    return s.open_<async_read_write_file>(path, O_RDWR | O_CREAT, 0644);
+  }
+  friend open_sender<async_write_only_file> tag_invoke(
+      tag_t<async_open_file_write_only>,
+      scheduler s,
+      const filesystem::path& path) {
+    return s.open_<async_write_only_file>(path, O_WRONLY | O_CREAT, 0644);
+  }
+  friend open_sender<async_read_only_file> tag_invoke(
+      tag_t<async_open_file_read_only>,
+      scheduler s,
+      const filesystem::path& path,
+      const open_file_options& options) {
+    return s.open_<async_read_only_file>(
+        path, O_RDONLY | open_flags(options), 0);
+  }
+  friend open_sender<async_read_write_file> tag_invoke(
+      tag_t<async_open_file_read_write>,
+      scheduler s,
+      const filesystem::path& path,
+      const open_file_options& options) {
+    return s.open_<async_read_write_file>(
+        path, O_RDWR | O_CREAT | open_flags(options), 0644);
+  }
+  friend open_sender<async_write_only_file> tag_invoke(
+      tag_t<async_open_file_write_only>,
+      scheduler s,
+      const filesystem::path& path,
+      const open_file_options& options) {
+    return s.open_<async_write_only_file>(
+        path, O_WRONLY | O_CREAT | open_flags(options), 0644);
+  }
+  friend async_socket tag_invoke(
+      tag_t<open_socket>,
+      scheduler s,
+      int domain,
+      int type,
+      int protocol);
+  friend std::pair<async_reader, async_writer>
+  tag_invoke(tag_t<open_pipe>, scheduler s);
 
   friend bool operator==(scheduler a, scheduler b) noexcept {
     return a.context_ == b.context_;
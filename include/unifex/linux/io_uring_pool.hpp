@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <unifex/config.hpp>
+#if !UNIFEX_NO_LIBURING
+
+#include <unifex/file_concepts.hpp>
+#include <unifex/filesystem.hpp>
+#include <unifex/inplace_stop_token.hpp>
+#include <unifex/socket_concepts.hpp>
+#include <unifex/tag_invoke.hpp>
+
+#include <unifex/linux/io_uring_context.hpp>
+#include <unifex/linux/monotonic_clock.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <unifex/detail/prologue.hpp>
+
+namespace unifex {
+namespace linuxos {
+
+// A set of io_uring_contexts, each run by its own thread pinned to a CPU.
+//
+// Work scheduled through get_scheduler() from one of the pool's threads
+// stays on that thread's ring. Work scheduled from any other thread is
+// spread over the rings round-robin. Files and sockets opened through the
+// scheduler belong to the ring that opened them, and their I/O is always
+// submitted by that ring's thread.
+//
+// When one ring hands work to another, the other ring is woken up with
+// IORING_OP_MSG_RING where the kernel supports it rather than with an
+// eventfd write.
+class io_uring_pool {
+ public:
+  class scheduler;
+
+  struct options {
+    // Number of rings. Zero means one per CPU that the process may run on.
+    std::uint32_t ringCount = 0;
+
+    // When true, the thread of ring 'i' is pinned to the i'th CPU that the
+    // process may run on, wrapping around if there are more rings than
+    // CPUs.
+    bool pinThreads = true;
+
+    // Options for each of the rings.
+    io_uring_context::options ring;
+  };
+
+  io_uring_pool();
+
+  explicit io_uring_pool(const options& opts);
+
+  // Stops and joins all of the threads. Work that has not yet run on a
+  // ring by then is abandoned.
+  ~io_uring_pool();
+
+  scheduler get_scheduler() noexcept;
+
+  // The scheduler of ring 'index', for pinning work to a particular ring.
+  io_uring_context::scheduler get_scheduler(std::uint32_t index) noexcept {
+    UNIFEX_ASSERT(index < rings_.size());
+    return rings_[index]->get_scheduler();
+  }
+
+  std::uint32_t size() const noexcept {
+    return static_cast<std::uint32_t>(rings_.size());
+  }
+
+ private:
+  // The ring of the calling thread if it is one of the pool's threads,
+  // otherwise the next ring in round-robin order.
+  io_uring_context& select_ring() noexcept;
+
+  void run(std::uint32_t index);
+  void request_stop_and_join() noexcept;
+
+  std::vector<std::unique_ptr<io_uring_context>> rings_;
+  std::vector<std::thread> threads_;
+  inplace_stop_source stopSource_;
+  std::atomic<std::uint32_t> nextRing_{0};
+};
+
+class io_uring_pool::scheduler {
+ public:
+  scheduler(const scheduler&) noexcept = default;
+  scheduler& operator=(const scheduler&) = default;
+  ~scheduler() = default;
+
+  io_uring_context::schedule_sender schedule() const noexcept {
+    return ring_scheduler().schedule();
+  }
+
+  monotonic_clock::time_point now() const noexcept {
+    return monotonic_clock::now();
+  }
+
+  io_uring_context::schedule_at_sender
+  schedule_at(const monotonic_clock::time_point& dueTime) const noexcept {
+    return ring_scheduler().schedule_at(dueTime);
+  }
+
+ private:
+  friend io_uring_pool;
+
+  io_uring_context::scheduler ring_scheduler() const noexcept {
+    return pool_->select_ring().get_scheduler();
+  }
+
+  friend io_uring_context::async_read_only_file tag_invoke(
+      tag_t<open_file_read_only>,
+      scheduler s,
+      const filesystem::path& path) {
+    return open_file_read_only(s.ring_scheduler(), path);
+  }
+  friend io_uring_context::async_read_write_file tag_invoke(
+      tag_t<open_file_read_write>,
+      scheduler s,
+      const filesystem::path& path) {
+    return open_file_read_write(s.ring_scheduler(), path);
+  }
+  friend io_uring_context::async_write_only_file tag_invoke(
+      tag_t<open_file_write_only>,
+      scheduler s,
+      const filesystem::path& path) {
+    return open_file_write_only(s.ring_scheduler(), path);
+  }
+  friend io_uring_context::open_sender<io_uring_context::async_read_only_file>
+  tag_invoke(
+      tag_t<async_open_file_read_only>,
+      scheduler s,
+      const filesystem::path& path) {
+    return async_open_file_read_only(s.ring_scheduler(), path);
+  }
+  friend io_uring_context::open_sender<io_uring_context::async_read_write_file>
+  tag_invoke(
+      tag_t<async_open_file_read_write>,
+      scheduler s,
+      const filesystem::path& path) {
+    return async_open_file_read_write(s.ring_scheduler(), path);
+  }
+  friend io_uring_context::open_sender<io_uring_context::async_write_only_file>
+  tag_invoke(
+      tag_t<async_open_file_write_only>,
+      scheduler s,
+      const filesystem::path& path) {
+    return async_open_file_write_only(s.ring_scheduler(), path);
+  }
+  friend io_uring_context::async_read_only_file tag_invoke(
+      tag_t<open_file_read_only>,
+      scheduler s,
+      const filesystem::path& path,
+      const open_file_options& options) {
+    return open_file_read_only(s.ring_scheduler(), path, options);
+  }
+  friend io_uring_context::async_read_write_file tag_invoke(
+      tag_t<open_file_read_write>,
+      scheduler s,
+      const filesystem::path& path,
+      const open_file_options& options) {
+    return open_file_read_write(s.ring_scheduler(), path, options);
+  }
+  friend io_uring_context::async_write_only_file tag_invoke(
+      tag_t<open_file_write_only>,
+      scheduler s,
+      const filesystem::path& path,
+      const open_file_options& options) {
+    return open_file_write_only(s.ring_scheduler(), path, options);
+  }
+  friend io_uring_context::open_sender<io_uring_context::async_read_only_file>
+  tag_invoke(
+      tag_t<async_open_file_read_only>,
+      scheduler s,
+      const filesystem::path& path,
+      const open_file_options& options) {
+    return async_open_file_read_only(s.ring_scheduler(), path, options);
+  }
+  friend io_uring_context::open_sender<io_uring_context::async_read_write_file>
+  tag_invoke(
+      tag_t<async_open_file_read_write>,
+      scheduler s,
+      const filesystem::path& path,
+      const open_file_options& options) {
+    return async_open_file_read_write(s.ring_scheduler(), path, options);
+  }
+  friend io_uring_context::open_sender<io_uring_context::async_write_only_file>
+  tag_invoke(
+      tag_t<async_open_file_write_only>,
+      scheduler s,
+      const filesystem::path& path,
+      const open_file_options& options) {
+    return async_open_file_write_only(s.ring_scheduler(), path, options);
+  }
+  friend io_uring_context::async_socket tag_invoke(
+      tag_t<open_socket>,
+      scheduler s,
+      int domain,
+      int type,
+      int protocol) {
+    return open_socket(s.ring_scheduler(), domain, type, protocol);
+  }
+
+  friend bool operator==(scheduler a, scheduler b) noexcept {
+    return a.pool_ == b.pool_;
+  }
+  friend bool operator!=(scheduler a, scheduler b) noexcept {
+    return a.pool_ != b.pool_;
+  }
+
+  explicit scheduler(io_uring_pool& pool) noexcept : pool_(&pool) {}
+
+  io_uring_pool* pool_;
+};
+
+inline io_uring_pool::scheduler io_uring_pool::get_scheduler() noexcept {
+  return scheduler{*this};
+}
+
+} // namespace linuxos
+} // namespace unifex
+
+#include <unifex/detail/epilogue.hpp>
+
+#endif // !UNIFEX_NO_LIBURING
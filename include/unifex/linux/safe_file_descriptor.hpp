@@ -52,6 +52,11 @@ class safe_file_descriptor {
 
   void close() noexcept;
 
+  // Gives up ownership of the descriptor without closing it.
+  int release() noexcept {
+    return std::exchange(fd_, -1);
+  }
+
  private:
   int fd_;
 };
@@ -17,10 +17,11 @@
 
 #include <unifex/blocking.hpp>
 #include <unifex/get_stop_token.hpp>
+#include <unifex/idle_strategy.hpp>
 #include <unifex/receiver_concepts.hpp>
 #include <unifex/stop_token_concepts.hpp>
+#include <unifex/detail/event_count.hpp>
 
-#include <condition_variable>
 #include <mutex>
 #include <type_traits>
 
@@ -141,6 +142,12 @@ class context {
     context* loop_;
   };
 
+  context() noexcept = default;
+
+  // 'idle' controls how run() waits when there are no tasks to execute.
+  explicit context(const idle_strategy& idle) noexcept
+    : idle_(idle) {}
+
   scheduler get_scheduler() {
     return scheduler{this};
   }
@@ -152,8 +159,13 @@ class context {
  private:
   void enqueue(task_base* task);
 
+  // Wait, following idle_, until a task is enqueued or stop() is called.
+  // Releases 'lock' while waiting.
+  void wait(std::unique_lock<std::mutex>& lock);
+
   std::mutex mutex_;
-  std::condition_variable cv_;
+  event_count wakeup_;
+  idle_strategy idle_;
   task_base* head_ = nullptr;
   task_base* tail_ = nullptr;
   bool stop_ = false;
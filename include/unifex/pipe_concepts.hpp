@@ -19,6 +19,9 @@
 
 #include <unifex/io_concepts.hpp>
 
+#include <cstddef>
+#include <cstdint>
+
 #include <unifex/detail/prologue.hpp>
 
 namespace unifex {
@@ -35,9 +38,67 @@ inline const struct open_pipe_cpo {
     return unifex::tag_invoke(*this, (Executor &&) executor);
   }
 } open_pipe{};
+
+// async_splice(source, sourceOffset, destination, destinationOffset, length)
+//
+// Returns a sender that moves up to 'length' bytes from 'source' to
+// 'destination' without copying them through user space, and produces the
+// number of bytes moved. At least one of the two must be a pipe. The offset
+// of a pipe or a socket must be -1.
+inline const struct async_splice_cpo {
+  template <typename Source, typename Destination>
+  auto operator()(
+      Source& source,
+      std::int64_t sourceOffset,
+      Destination& destination,
+      std::int64_t destinationOffset,
+      std::size_t length) const
+      noexcept(is_nothrow_tag_invocable_v<
+               async_splice_cpo,
+               Source&,
+               std::int64_t,
+               Destination&,
+               std::int64_t,
+               std::size_t>)
+          -> tag_invoke_result_t<
+              async_splice_cpo,
+              Source&,
+              std::int64_t,
+              Destination&,
+              std::int64_t,
+              std::size_t> {
+    return unifex::tag_invoke(
+        *this, source, sourceOffset, destination, destinationOffset, length);
+  }
+} async_splice{};
+
+// async_tee(source, destination, length)
+//
+// Returns a sender that copies up to 'length' bytes from the read end of one
+// pipe to the write end of another without consuming them from 'source',
+// and produces the number of bytes copied.
+inline const struct async_tee_cpo {
+  template <typename Source, typename Destination>
+  auto operator()(
+      Source& source, Destination& destination, std::size_t length) const
+      noexcept(is_nothrow_tag_invocable_v<
+               async_tee_cpo,
+               Source&,
+               Destination&,
+               std::size_t>)
+          -> tag_invoke_result_t<
+              async_tee_cpo,
+              Source&,
+              Destination&,
+              std::size_t> {
+    return unifex::tag_invoke(*this, source, destination, length);
+  }
+} async_tee{};
 } // namespace _pipe_cpo
 
 using _pipe_cpo::open_pipe;
+using _pipe_cpo::async_splice;
+using _pipe_cpo::async_tee;
 } // namespace unifex
 
 #include <unifex/detail/epilogue.hpp>
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <unifex/config.hpp>
+#include <unifex/defer.hpp>
+#include <unifex/exception.hpp>
+#include <unifex/let_value_with.hpp>
+#include <unifex/pipe_concepts.hpp>
+#include <unifex/repeat_effect_until.hpp>
+#include <unifex/then.hpp>
+#include <unifex/when_all.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <system_error>
+#include <utility>
+
+#include <unifex/detail/prologue.hpp>
+
+namespace unifex
+{
+  namespace _sendfile {
+    // Never have more than this many bytes in flight in the pipe: the
+    // default capacity of a Linux pipe, so that filling it never waits for
+    // it to be drained.
+    inline constexpr std::size_t chunk_size = 64 * 1024;
+
+    template <typename Pipe>
+    struct state {
+      Pipe pipe_;
+      std::int64_t offset_;
+      std::size_t remaining_;
+      // Only written by the splice into the pipe.
+      std::size_t filled_ = 0;
+      // Only written by the splice out of the pipe.
+      std::size_t sent_ = 0;
+
+      std::size_t buffered() const noexcept { return filled_ - sent_; }
+
+      void filled(std::int64_t bytes, std::size_t requested) noexcept {
+        if (bytes == 0 && requested != 0) {
+          // The file is shorter than the range.
+          remaining_ = 0;
+          return;
+        }
+        offset_ += bytes;
+        filled_ += static_cast<std::size_t>(bytes);
+        remaining_ -= static_cast<std::size_t>(bytes);
+      }
+
+      void sent(std::int64_t bytes, std::size_t requested) {
+        if (bytes == 0 && requested != 0) {
+          throw_(std::system_error{
+              std::make_error_code(std::errc::broken_pipe)});
+        }
+        sent_ += static_cast<std::size_t>(bytes);
+      }
+
+      bool done() const noexcept {
+        return remaining_ == 0 && buffered() == 0;
+      }
+    };
+
+    inline const struct _fn {
+      // Moves 'length' bytes of 'file' starting at 'offset' to
+      // 'destination' through a pipe opened on 'scheduler', and produces the
+      // number of bytes moved. Each round splices the next chunk of the file
+      // into the pipe while the previous chunk is spliced out of it.
+      template <typename Scheduler, typename File, typename Destination>
+      auto operator()(
+          Scheduler&& scheduler,
+          File& file,
+          std::int64_t offset,
+          std::size_t length,
+          Destination& destination) const {
+        using pipe_t = decltype(open_pipe((Scheduler &&) scheduler));
+        return let_value_with(
+            [scheduler = (Scheduler &&) scheduler, offset, length]() {
+              return state<pipe_t>{open_pipe(scheduler), offset, length};
+            },
+            [&file, &destination](state<pipe_t>& s) {
+              return then(
+                  repeat_effect_until(
+                      defer([&file, &destination, &s] {
+                        const std::size_t fillLength =
+                            std::min(s.remaining_, chunk_size - s.buffered());
+                        const std::size_t sendLength = s.buffered();
+                        return then(
+                            when_all(
+                                then(
+                                    async_splice(
+                                        file,
+                                        s.offset_,
+                                        s.pipe_.second,
+                                        -1,
+                                        fillLength),
+                                    [&s, fillLength](
+                                        std::int64_t bytes) noexcept {
+                                      s.filled(bytes, fillLength);
+                                    }),
+                                then(
+                                    async_splice(
+                                        s.pipe_.first,
+                                        -1,
+                                        destination,
+                                        -1,
+                                        sendLength),
+                                    [&s, sendLength](std::int64_t bytes) {
+                                      s.sent(bytes, sendLength);
+                                    })),
+                            [](auto&&...) noexcept {});
+                      }),
+                      [&s]() noexcept { return s.done(); }),
+                  [&s]() noexcept { return s.sent_; });
+            });
+      }
+    } async_sendfile{};
+  } // namespace _sendfile
+  using _sendfile::async_sendfile;
+} // namespace unifex
+
+#include <unifex/detail/epilogue.hpp>
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <unifex/tag_invoke.hpp>
+
+#include <unifex/io_concepts.hpp>
+
+#include <unifex/detail/prologue.hpp>
+
+namespace unifex {
+namespace _socket_cpo {
+// open_socket(executor, domain, type, protocol)
+//
+// Synchronously creates a socket associated with the executor's context.
+inline const struct open_socket_cpo {
+  template <typename Executor>
+  auto operator()(
+      Executor&& executor, int domain, int type, int protocol = 0) const
+      noexcept(is_nothrow_tag_invocable_v<
+               open_socket_cpo,
+               Executor,
+               int,
+               int,
+               int>)
+          -> tag_invoke_result_t<open_socket_cpo, Executor, int, int, int> {
+    return unifex::tag_invoke(
+        *this, (Executor &&) executor, domain, type, protocol);
+  }
+} open_socket{};
+
+// async_accept(listeningSocket)
+//
+// Returns a sender that produces the socket of the next incoming connection.
+inline const struct async_accept_cpo {
+  template <typename Socket>
+  auto operator()(Socket& socket) const
+      noexcept(is_nothrow_tag_invocable_v<async_accept_cpo, Socket&>)
+          -> tag_invoke_result_t<async_accept_cpo, Socket&> {
+    return unifex::tag_invoke(*this, socket);
+  }
+} async_accept{};
+
+// accept_stream(listeningSocket)
+//
+// Returns a stream of the sockets of incoming connections, which keeps
+// accepting connections for as long as the stream is consumed.
+inline const struct accept_stream_cpo {
+  template <typename Socket>
+  auto operator()(Socket& socket) const
+      noexcept(is_nothrow_tag_invocable_v<accept_stream_cpo, Socket&>)
+          -> tag_invoke_result_t<accept_stream_cpo, Socket&> {
+    return unifex::tag_invoke(*this, socket);
+  }
+} accept_stream{};
+
+// async_connect(socket, address...)
+//
+// Returns a sender that completes once the socket is connected to the
+// address, which is given in whatever form the socket type takes.
+inline const struct async_connect_cpo {
+  template <typename Socket, typename... Address>
+  auto operator()(Socket& socket, Address&&... address) const
+      noexcept(is_nothrow_tag_invocable_v<async_connect_cpo, Socket&, Address...>)
+          -> tag_invoke_result_t<async_connect_cpo, Socket&, Address...> {
+    return unifex::tag_invoke(*this, socket, (Address &&) address...);
+  }
+} async_connect{};
+
+// async_send_msg(socket, message...) / async_recv_msg(socket, message...)
+//
+// Returns a sender that sends or receives a message, eg. a POSIX msghdr,
+// and produces the number of bytes transferred. The message must stay alive
+// until the operation completes.
+inline const struct async_send_msg_cpo {
+  template <typename Socket, typename... Message>
+  auto operator()(Socket& socket, Message&&... message) const
+      noexcept(is_nothrow_tag_invocable_v<async_send_msg_cpo, Socket&, Message...>)
+          -> tag_invoke_result_t<async_send_msg_cpo, Socket&, Message...> {
+    return unifex::tag_invoke(*this, socket, (Message &&) message...);
+  }
+} async_send_msg{};
+
+inline const struct async_recv_msg_cpo {
+  template <typename Socket, typename... Message>
+  auto operator()(Socket& socket, Message&&... message) const
+      noexcept(is_nothrow_tag_invocable_v<async_recv_msg_cpo, Socket&, Message...>)
+          -> tag_invoke_result_t<async_recv_msg_cpo, Socket&, Message...> {
+    return unifex::tag_invoke(*this, socket, (Message &&) message...);
+  }
+} async_recv_msg{};
+
+// recv_stream(socket, buffers...)
+//
+// Returns a stream of the data received on the socket, each value of which
+// holds the data of one receive. The buffers are given in whatever form the
+// socket type takes.
+inline const struct recv_stream_cpo {
+  template <typename Socket, typename... Buffers>
+  auto operator()(Socket& socket, Buffers&&... buffers) const
+      noexcept(is_nothrow_tag_invocable_v<recv_stream_cpo, Socket&, Buffers...>)
+          -> tag_invoke_result_t<recv_stream_cpo, Socket&, Buffers...> {
+    return unifex::tag_invoke(*this, socket, (Buffers &&) buffers...);
+  }
+} recv_stream{};
+} // namespace _socket_cpo
+
+using _socket_cpo::open_socket;
+using _socket_cpo::async_accept;
+using _socket_cpo::accept_stream;
+using _socket_cpo::async_connect;
+using _socket_cpo::async_send_msg;
+using _socket_cpo::async_recv_msg;
+using _socket_cpo::recv_stream;
+} // namespace unifex
+
+#include <unifex/detail/epilogue.hpp>
@@ -15,19 +15,36 @@
  */
 #pragma once
 
+#include <cstdint>
 #include <thread>
 
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#endif
+
 #include <unifex/detail/prologue.hpp>
 
 namespace unifex {
 
+// Hint to the CPU that the calling thread is busy-waiting so that it can
+// save power and give resources to a sibling hyper-thread.
+inline void spin_loop_pause() noexcept {
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+  _mm_pause();
+#elif defined(__i386__) || defined(__x86_64__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__) || (defined(__arm__) && __ARM_ARCH >= 7)
+  __asm__ __volatile__("yield" ::: "memory");
+#endif
+}
+
 class spin_wait {
  public:
   spin_wait() noexcept = default;
 
   void wait() noexcept {
     if (count_++ < yield_threshold) {
-      // TODO: _mm_pause();
+      spin_loop_pause();
     } else {
       if (count_ == 0) {
         count_ = yield_threshold;
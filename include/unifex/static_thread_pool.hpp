@@ -15,27 +15,85 @@
  */
 #pragma once
 
+#include <unifex/config.hpp>
+#include <unifex/bulk_schedule.hpp>
+#include <unifex/execution_policy.hpp>
+#include <unifex/get_execution_policy.hpp>
 #include <unifex/get_stop_token.hpp>
+#include <unifex/idle_strategy.hpp>
+#include <unifex/manual_lifetime.hpp>
 #include <unifex/receiver_concepts.hpp>
 #include <unifex/scheduler_concepts.hpp>
 #include <unifex/sender_concepts.hpp>
 #include <unifex/stop_token_concepts.hpp>
+#include <unifex/detail/event_count.hpp>
+#include <unifex/detail/intrusive_heap.hpp>
 #include <unifex/detail/intrusive_queue.hpp>
+#include <unifex/detail/work_stealing_deque.hpp>
 
+#include <array>
+#include <chrono>
+#include <condition_variable>
 #include <thread>
 #include <type_traits>
 #include <vector>
 #include <atomic>
+#include <exception>
+#include <memory>
 #include <mutex>
-#include <condition_variable>
 
 #include <unifex/detail/prologue.hpp>
 
 namespace unifex {
 namespace _static_thread_pool {
+  using clock_t = std::chrono::steady_clock;
+  using time_point = typename clock_t::time_point;
+
+  class context;
+
   struct task_base {
     task_base* next;
     void (*execute)(task_base*) noexcept;
+#if UNIFEX_STATIC_THREAD_POOL_STATS
+    // When the task was scheduled, or a default constructed time_point for
+    // timers.
+    time_point enqueueTime{};
+#endif
+  };
+
+  // The lane a scheduler places its work in. Workers run work from higher
+  // priority lanes first.
+  enum class priority : std::uint8_t {
+    high,
+    normal,
+    low,
+  };
+  inline constexpr std::size_t priority_count = 3;
+
+  // A task that is held in one of the worker threads' timer queues until
+  // its due time.
+  struct timer_task_base : task_base {
+    explicit timer_task_base(context& pool) noexcept
+      : pool_(pool) {}
+
+    context& pool_;
+    timer_task_base* timerNext_ = nullptr;
+    timer_task_base* timerPrev_ = nullptr;
+    time_point dueTime_;
+    // The lane the task runs in once it is due.
+    priority priority_ = priority::normal;
+    // Index of the thread whose timer queue holds this task.
+    std::uint32_t timerShard_ = 0;
+    bool timerQueued_ = false;
+  };
+
+  class timer_cancel_callback {
+    timer_task_base* const task_;
+   public:
+    explicit timer_cancel_callback(timer_task_base* task) noexcept
+      : task_(task) {}
+
+    void operator()() noexcept;
   };
 
   template <typename Receiver>
@@ -45,17 +103,156 @@ namespace _static_thread_pool {
   template <typename Receiver>
   using operation = typename _op<remove_cvref_t<Receiver>>::type;
 
+  template <typename Integral, typename Receiver>
+  struct _bulk_op {
+    class type;
+  };
+  template <typename Integral, typename Receiver>
+  using bulk_operation =
+      typename _bulk_op<Integral, remove_cvref_t<Receiver>>::type;
+
+  template <typename Integral>
+  struct _bulk_sender {
+    class type;
+  };
+  template <typename Integral>
+  using bulk_schedule_sender = typename _bulk_sender<Integral>::type;
+
+  template <typename Receiver>
+  struct _timer_op {
+    class type;
+  };
+  template <typename Receiver>
+  using timer_operation = typename _timer_op<remove_cvref_t<Receiver>>::type;
+
+  struct options {
+    // A group of worker threads that share a set of CPUs, typically the
+    // CPUs of a single NUMA node.
+    struct partition {
+      // Number of worker threads in the partition. Zero means one thread
+      // per CPU listed in 'cpus'. The pool constructor throws
+      // std::invalid_argument if that leaves the partition without threads.
+      std::uint32_t threadCount = 0;
+
+      // CPUs that the partition's threads are pinned to. Empty means the
+      // threads are not pinned. Pinning is only supported on Linux.
+      std::vector<std::uint32_t> cpus;
+    };
+
+    // Number of worker threads. Zero means std::thread::hardware_concurrency().
+    std::uint32_t threadCount = 0;
+
+    // When true, tasks scheduled from one of the pool's own threads are
+    // pushed onto a lock-free deque owned by that thread. The owner pops
+    // from its deque without taking any locks while idle threads steal
+    // from the other end. Tasks scheduled from outside the pool still go
+    // through the per-thread locked queues.
+    bool workStealing = false;
+
+    // When non-empty the pool is split into these partitions and
+    // 'threadCount' is ignored.
+    //
+    // Work scheduled through get_scheduler() is placed on the partition of
+    // the submitting thread: the worker's own partition when called from
+    // the pool, otherwise the partition that owns the CPU the caller is
+    // running on (or round-robin if that is unknown). Idle workers only look
+    // at other partitions once their own partition has run out of work.
+    std::vector<partition> partitions;
+
+    // How a worker that has run out of work waits for more.
+    idle_strategy idle;
+
+    // When true, a normal priority task scheduled from one of the pool's
+    // threads is placed in that thread's single-entry "run next" slot and
+    // runs as soon as the current task returns, keeping continuations on
+    // a warm cache. Any task it displaces is scheduled as usual.
+    //
+    // Idle threads are not woken for the slot and only take a task from
+    // another thread's slot as a last resort, so a task must not block
+    // waiting for work it has just scheduled onto the pool.
+    bool runNext = false;
+
+    // Returns one partition per NUMA node with a thread pinned to each of
+    // the node's CPUs, or an empty list if the topology is not available.
+    static std::vector<partition> numa_partitions();
+
+    // The number of tasks a worker runs from higher priority lanes while a
+    // lower priority lane has work, before it runs one task from that lane.
+    std::uint32_t starvationLimit = 16;
+
+    // Elastic mode. When greater than the initial thread count, the pool
+    // starts 'threadCount' workers and adds more, up to 'maxThreadCount',
+    // while work is backing up. The extra workers exit again once they have
+    // been idle for 'keepAlive'. Cannot be combined with 'partitions', the
+    // pool constructor throws std::invalid_argument if both are set.
+    std::uint32_t maxThreadCount = 0;
+
+    // A worker's queue is backing up once it holds 'growQueueDepth' tasks or
+    // has not been empty for 'growWaitTime'. This is checked whenever work is
+    // scheduled onto the queue or taken from it and, while any queue holds
+    // work, every 'growWaitTime' by a monitor thread.
+    std::uint32_t growQueueDepth = 4;
+    std::chrono::milliseconds growWaitTime{10};
+
+    std::chrono::milliseconds keepAlive{5000};
+  };
+
+  // Buckets of the start latency histogram. Bucket 0 counts tasks that
+  // started less than 1us after being scheduled, bucket i > 0 those that took
+  // [2^(i-1), 2^i)us and the last bucket everything slower.
+  inline constexpr std::size_t latency_bucket_count = 24;
+
+  // A snapshot of one worker thread's statistics.
+  struct worker_stats {
+    std::uint64_t tasksExecuted = 0;
+    // Tasks taken from another worker's queue, deque or run-next slot.
+    std::uint64_t tasksStolen = 0;
+    // Time spent running tasks and waiting for work.
+    clock_t::duration busyTime{};
+    clock_t::duration idleTime{};
+    // Failed try_lock attempts on this worker's queue when popping from or
+    // pushing to it.
+    std::uint64_t popContention = 0;
+    std::uint64_t pushContention = 0;
+    // The largest number of tasks seen in this worker's queue.
+    std::uint32_t maxQueueDepth = 0;
+    // Time from scheduling a task to it starting on this worker.
+    std::array<std::uint64_t, latency_bucket_count> startLatency{};
+  };
+
+  struct stats {
+    // One entry per worker thread. Empty unless the library is built with
+    // UNIFEX_STATIC_THREAD_POOL_STATS.
+    std::vector<worker_stats> workers;
+  };
+
   class context {
     template <typename Receiver>
     friend struct _op;
+    template <typename Integral, typename Receiver>
+    friend struct _bulk_op;
+    template <typename Integral>
+    friend struct _bulk_sender;
+    template <typename Receiver>
+    friend struct _timer_op;
+    friend timer_cancel_callback;
   public:
+    using clock_t = _static_thread_pool::clock_t;
+    using time_point = _static_thread_pool::time_point;
+    using priority = _static_thread_pool::priority;
+
     context();
     context(std::uint32_t threadCount);
+    explicit context(const options& opts);
     ~context();
 
     class scheduler {
       template <typename Receiver>
       friend struct _op;
+      template <typename Receiver>
+      friend struct _timer_op;
+      template <typename Integral>
+      friend struct _bulk_sender;
       class schedule_sender {
       public:
         template <
@@ -71,7 +268,8 @@ namespace _static_thread_pool {
       private:
         template <typename Receiver>
         operation<Receiver> make_operation_(Receiver&& r) const {
-          return operation<Receiver>{pool_, (Receiver &&) r};
+          return operation<Receiver>{
+              pool_, partition_, priority_, (Receiver &&) r};
         }
 
         template(typename Receiver)
@@ -83,14 +281,19 @@ namespace _static_thread_pool {
 
         friend class context::scheduler;
 
-        explicit schedule_sender(context& pool) noexcept
-          : pool_(pool) {}
+        explicit schedule_sender(
+            context& pool, std::uint32_t partition, priority prio) noexcept
+          : pool_(pool)
+          , partition_(partition)
+          , priority_(prio) {}
 
         context& pool_;
+        std::uint32_t partition_;
+        priority priority_;
       };
 
       schedule_sender make_sender_() const {
-        return schedule_sender{pool_};
+        return schedule_sender{pool_, partition_, priority_};
       }
 
       friend schedule_sender
@@ -98,49 +301,478 @@ namespace _static_thread_pool {
         return s.make_sender_();
       }
 
+      template <typename Integral>
+      bulk_schedule_sender<Integral> make_bulk_sender_(Integral n) const noexcept {
+        return bulk_schedule_sender<Integral>{pool_, partition_, priority_, n};
+      }
+
+      template(typename Integral)
+        (requires std::is_integral_v<Integral>)
+      friend bulk_schedule_sender<Integral>
+      tag_invoke(tag_t<bulk_schedule>, const scheduler& s, Integral n) noexcept {
+        return s.make_bulk_sender_(n);
+      }
+
+      class schedule_at_sender {
+      public:
+        template <
+            template <typename...> class Variant,
+            template <typename...> class Tuple>
+        using value_types = Variant<Tuple<>>;
+
+        template <template <typename...> class Variant>
+        using error_types = Variant<>;
+
+        static constexpr bool sends_done = true;
+
+      private:
+        template <typename Receiver>
+        timer_operation<Receiver> make_operation_(Receiver&& r) const {
+          return timer_operation<Receiver>{
+              pool_,
+              partition_,
+              priority_,
+              dueTime_,
+              delay_,
+              relative_,
+              (Receiver &&) r};
+        }
+
+        template(typename Receiver)
+          (requires receiver_of<Receiver>)
+        friend timer_operation<Receiver>
+        tag_invoke(tag_t<connect>, const schedule_at_sender& s, Receiver&& r) {
+          return s.make_operation_((Receiver &&) r);
+        }
+
+        friend class context::scheduler;
+
+        explicit schedule_at_sender(
+            context& pool,
+            std::uint32_t partition,
+            priority prio,
+            time_point dueTime,
+            clock_t::duration delay,
+            bool relative) noexcept
+          : pool_(pool)
+          , partition_(partition)
+          , priority_(prio)
+          , dueTime_(dueTime)
+          , delay_(delay)
+          , relative_(relative) {}
+
+        context& pool_;
+        std::uint32_t partition_;
+        priority priority_;
+        time_point dueTime_;
+        // If 'relative_' then the timer is due 'delay_' after the operation
+        // is started rather than at 'dueTime_'.
+        clock_t::duration delay_;
+        bool relative_;
+      };
+
+    public:
+      time_point now() const noexcept {
+        return clock_t::now();
+      }
+
+      // Once due, timers run in the scheduler's priority lane, ahead of the
+      // work already queued there.
+      schedule_at_sender schedule_at(time_point dueTime) const noexcept {
+        return schedule_at_sender{
+            pool_,
+            partition_,
+            priority_,
+            dueTime,
+            clock_t::duration::zero(),
+            false};
+      }
+
+      template <typename Rep, typename Ratio>
+      schedule_at_sender
+      schedule_after(std::chrono::duration<Rep, Ratio> delay) const noexcept {
+        // Round up so that the timer never fires early.
+        return schedule_at_sender{
+            pool_,
+            partition_,
+            priority_,
+            time_point{},
+            std::chrono::ceil<clock_t::duration>(delay),
+            true};
+      }
+
+    private:
       friend class context;
-      explicit scheduler(context& pool) noexcept
-        : pool_(pool) {}
+      explicit scheduler(
+          context& pool, std::uint32_t partition, priority prio) noexcept
+        : pool_(pool)
+        , partition_(partition)
+        , priority_(prio) {}
 
       friend bool operator==(scheduler a, scheduler b) noexcept {
-        return &a.pool_ == &b.pool_;
+        return &a.pool_ == &b.pool_ && a.partition_ == b.partition_ &&
+            a.priority_ == b.priority_;
       }
       friend bool operator!=(scheduler a, scheduler b) noexcept {
-        return &a.pool_ != &b.pool_;
+        return !(a == b);
       }
 
       context& pool_;
+      std::uint32_t partition_;
+      priority priority_;
     };
 
-    scheduler get_scheduler() noexcept { return scheduler{*this}; }
+    // Returns a scheduler that places work on any partition, preferring the
+    // partition of the thread that schedules it.
+    scheduler get_scheduler(priority prio = priority::normal) noexcept {
+      return scheduler{*this, any_partition, prio};
+    }
+
+    // Returns a scheduler that places work on the threads of the given
+    // partition. Threads of other partitions may still steal the work
+    // once they run out of their own.
+    scheduler get_partition_scheduler(
+        std::uint32_t partition, priority prio = priority::normal) noexcept {
+      UNIFEX_ASSERT(partition < partitions_.size());
+      return scheduler{*this, partition, prio};
+    }
+
+    std::uint32_t partition_count() const noexcept {
+      return static_cast<std::uint32_t>(partitions_.size());
+    }
 
     void request_stop() noexcept;
 
+    static constexpr bool stats_enabled = UNIFEX_STATIC_THREAD_POOL_STATS;
+
+    // A snapshot of the statistics collected so far. The counters are read
+    // individually so the snapshot may not be consistent while the pool is
+    // busy.
+    _static_thread_pool::stats stats() const;
+
+    // The number of worker threads currently running. Only changes in
+    // elastic mode.
+    std::uint32_t running_thread_count() const noexcept {
+      return activeThreadCount_.load(std::memory_order_relaxed);
+    }
+
+    using task_queue = intrusive_queue<task_base, &task_base::next>;
+
+    // Collects the tasks of operations started on the current thread
+    // through a given scheduler while the batch is alive and submits them
+    // to the pool together, spreading them over the workers with a single
+    // lock acquisition per worker queue and waking only as many idle
+    // workers as there are tasks.
+    //
+    // Intended for algorithms that start many operations at once, eg.
+    // when_all() or async_scope, when they know they are scheduling onto
+    // the pool. The tasks do not run until the batch is submitted, so the
+    // caller must not block waiting for them while the batch is alive.
+    class batch {
+    public:
+      explicit batch(const scheduler& s) noexcept;
+      ~batch();
+
+      batch(const batch&) = delete;
+      batch& operator=(const batch&) = delete;
+
+      // Submit the tasks collected so far.
+      void submit() noexcept;
+
+    private:
+      friend context;
+
+      context& pool_;
+      std::uint32_t partition_;
+      priority priority_;
+      task_queue tasks_;
+      std::uint32_t count_ = 0;
+      batch* previous_;
+    };
+
   private:
+    static constexpr std::uint32_t any_partition = ~std::uint32_t(0);
+
+    // A contiguous range of thread indices and a round-robin counter used
+    // to spread work over them.
+    struct thread_range {
+      std::uint32_t begin_ = 0;
+      std::uint32_t end_ = 0;
+      std::atomic<std::uint32_t> nextThread_{0};
+      // The earliest due time, as a count of clock ticks, of the timers held
+      // by the range's threads. Idle threads wait until then rather than
+      // only for their own timers, so that the due timers of a thread busy
+      // with a long task are taken and run elsewhere. May be earlier than
+      // that once those timers have run.
+      std::atomic<clock_t::rep> nextTimerDue_{
+          time_point::max().time_since_epoch().count()};
+      // Held while nextTimerDue_ is recomputed or lowered.
+      std::mutex timerMut_;
+
+      std::uint32_t size() const noexcept { return end_ - begin_; }
+    };
+
     class thread_state {
     public:
       task_base* try_pop();
-      task_base* pop();
-      bool try_push(task_base* task);
-      void push(task_base* task);
+      // Returns nullptr once stop is requested or, if nothing turns up
+      // before then, at 'deadline' or once a timer of the partition is due.
+      task_base* pop(const idle_strategy& idle, time_point deadline);
+      // The push functions fail if the thread has retired.
+      bool try_push(task_base* task, priority prio);
+      bool push(task_base* task, priority prio);
+      bool push(task_queue& tasks, std::uint32_t count, priority prio);
       void request_stop();
+      bool stop_requested();
+
+      // Work-stealing or elastic mode only.
+      //
+      // Block until either a task is pushed to this thread's queue, the
+      // thread is woken by notify(), stop is requested, 'deadline' is
+      // reached or a timer of the partition is due. Returns the task from
+      // the queue, if any.
+      task_base* wait(const idle_strategy& idle, time_point deadline);
+      void notify();
+
+      // Elastic mode only.
+      //
+      // Make subsequent pushes fail and move any queued tasks to 'heir'.
+      void retire(thread_state& heir);
+      void reactivate();
+
+      // A snapshot of whether the queue is backing up.
+      bool backlogged(
+          std::uint32_t depth, clock_t::duration waitTime) const noexcept;
+
+#if UNIFEX_STATIC_THREAD_POOL_STATS
+      // Written by the owning thread, except for the contention counters
+      // and maxQueueDepth_. On separate cache-lines from the rest of the
+      // state.
+      struct alignas(64) counters {
+        std::atomic<std::uint64_t> tasksExecuted_{0};
+        std::atomic<std::uint64_t> tasksStolen_{0};
+        std::atomic<clock_t::rep> busyTime_{0};
+        std::atomic<clock_t::rep> idleTime_{0};
+        std::atomic<std::uint64_t> popContention_{0};
+        std::atomic<std::uint64_t> pushContention_{0};
+        std::atomic<std::uint32_t> maxQueueDepth_{0};
+        std::atomic<std::uint64_t> startLatency_[latency_bucket_count] = {};
+      };
+      counters stats_;
+#endif
+
+      // Lock-free deque of tasks scheduled by this thread.
+      work_stealing_deque<task_base> local_;
+      // The task to run after the current one. Only ever set by this
+      // thread, but may be taken by others.
+      std::atomic<task_base*> runNext_{nullptr};
+      std::atomic<bool> sleeping_{false};
+
+      // Index of the partition this thread belongs to.
+      std::uint32_t partition_ = 0;
+      // The nextTimerDue_ of that partition.
+      const std::atomic<clock_t::rep>* partitionTimerDue_ = nullptr;
+
+      std::uint32_t starvationLimit_ = 0;
+
+      // Whether to record when the queue last became non-empty, for
+      // backlogged().
+      bool trackBacklog_ = false;
+
+      // A hint that the high priority lane is non-empty, for threads that
+      // usually run work from their local deque first.
+      bool has_high_priority_work() const noexcept {
+        return highPriorityCount_.load(std::memory_order_relaxed) != 0;
+      }
+      bool has_queued_work() const noexcept {
+        return !queues_empty_();
+      }
+
+      // Add a timer to this thread's timer queue. Once due, the timer is
+      // queued in its priority lane and returned by pop(), try_pop() or
+      // wait().
+      void add_timer(timer_task_base* task);
+      // Move a timer that is still queued to the front of the run queue.
+      void cancel_timer(timer_task_base* task);
+      // Move the due timers to the front of the lanes of 'to', which must
+      // not have retired, and set 'next' to the earliest due time of those
+      // left. Returns whether any were due.
+      bool take_due_timers(thread_state& to, time_point& next);
+      // Wake the thread if it is waiting, so that it looks again at when
+      // it next needs to wake up.
+      void wake();
 
     private:
+      using timer_heap = intrusive_heap<
+          timer_task_base,
+          &timer_task_base::timerNext_,
+          &timer_task_base::timerPrev_,
+          time_point,
+          &timer_task_base::dueTime_>;
+
+      // Move the timers that are due to the front of their priority lanes,
+      // in due order. Requires mut_.
+      void queue_due_timers_();
+      // Pop the timers that are due into 'due', by lane and in due order.
+      // Requires mut_.
+      bool pop_due_timers_(
+          task_queue (&due)[priority_count],
+          std::uint32_t (&counts)[priority_count]);
+      // Put the timers popped by pop_due_timers_() at the front of their
+      // lanes. Requires mut_.
+      void prepend_timers_(
+          task_queue (&due)[priority_count],
+          const std::uint32_t (&counts)[priority_count]) noexcept;
+      bool partition_timer_due_() const noexcept {
+        return partitionTimerDue_ != nullptr &&
+            partitionTimerDue_->load(std::memory_order_seq_cst) <=
+            clock_t::now().time_since_epoch().count();
+      }
+      // Remove and return the next task from the highest priority non-empty
+      // lane, unless a lower lane is due a turn. Requires mut_.
+      task_base* try_pop_queued_();
+      bool queues_empty_() const noexcept {
+        return queuedCount_.load(std::memory_order_relaxed) == 0;
+      }
+      void push_locked_(task_base* task, priority prio) noexcept;
+      // Account for 'count' tasks added to the queues. Requires mut_.
+      void add_queued_(std::uint32_t count) noexcept;
+      // Wait, following 'idle', until woken, the earliest timer is due or
+      // 'deadline' is reached. Requires mut_, which is released while
+      // waiting.
+      void wait_(
+          std::unique_lock<std::mutex>& lk,
+          const idle_strategy& idle,
+          time_point deadline);
+
       std::mutex mut_;
-      std::condition_variable cv_;
-      intrusive_queue<task_base, &task_base::next> queue_;
+      event_count wakeup_;
+      task_queue queues_[priority_count];
+      // Number of tasks run from higher lanes while each lane was non-empty.
+      std::uint32_t skipped_[priority_count] = {};
+      std::atomic<std::uint32_t> highPriorityCount_{0};
+      // Only written with mut_ held, but read without it by backlogged().
+      std::atomic<std::uint32_t> queuedCount_{0};
+      std::atomic<clock_t::rep> backlogSince_{0};
+      timer_heap timers_;
       bool stopRequested_ = false;
+      bool notified_ = false;
+      bool retired_ = false;
     };
 
     void run(std::uint32_t index) noexcept;
+    void run_work_stealing(std::uint32_t index) noexcept;
+    // Run a task on thread 'index', recording statistics if enabled.
+    void execute(std::uint32_t index, task_base* task) noexcept;
+    // No-ops unless UNIFEX_STATIC_THREAD_POOL_STATS is set.
+    void record_idle(thread_state& state, time_point since) noexcept;
+    void record_steal(std::uint32_t index) noexcept;
     void join() noexcept;
 
-    void enqueue(task_base* task) noexcept;
+    void enqueue(
+        task_base* task, std::uint32_t partition, priority prio) noexcept;
+    void enqueue(
+        task_queue tasks,
+        std::uint32_t count,
+        std::uint32_t partition,
+        priority prio) noexcept;
+
+    // Enqueue a task onto the queue of a specific thread.
+    void enqueue_on(
+        task_base* task, std::uint32_t index, priority prio) noexcept;
+
+    // The partition that work scheduled from the current (non-pool) thread
+    // should be placed on.
+    std::uint32_t submitting_partition() noexcept;
+
+    // Select the thread whose timer queue a timer scheduled onto the given
+    // partition should be added to.
+    std::uint32_t timer_shard_for(std::uint32_t partition) noexcept;
+
+    // Add the timer to the queue of thread task->timerShard_, waking the
+    // other threads of its partition if it is now the earliest there.
+    void add_timer(timer_task_base* task) noexcept;
+    // If a timer of the partition of thread 'index' is due, move every due
+    // timer of the partition to that thread's queue. Returns whether any
+    // were moved.
+    bool take_due_timers(std::uint32_t index) noexcept;
 
+    thread_range& threads_for(std::uint32_t partition) noexcept {
+      return partition == any_partition ? allThreads_ : partitions_[partition];
+    }
+
+    // The number of threads at the start of the range that work can be
+    // placed on.
+    std::uint32_t thread_count_for(const thread_range& threads) const noexcept {
+      return elastic_ ? activeThreadCount_.load(std::memory_order_acquire)
+                      : threads.size();
+    }
+
+    // Elastic mode only.
+    //
+    // The time at which an idle thread 'index' may retire.
+    time_point idle_deadline(std::uint32_t index) const noexcept;
+    // If 'state' is backlogged, wake a sleeping thread to take the work or
+    // start another thread.
+    void maybe_grow(const thread_state& state) noexcept;
+    void maybe_grow(bool backlogged) noexcept;
+    // Start another thread, unless stopping or all threads are running.
+    bool grow() noexcept;
+    // Body of the monitor thread, which checks the queues for a backlog
+    // every growWaitTime_ while any of them holds work.
+    void monitor_backlog() noexcept;
+    // Wake the monitor thread if it is waiting for work to be queued.
+    void wake_monitor() noexcept;
+    // Stop thread 'index' if it is the most recently started thread beyond
+    // the minimum. Returns false if it must keep running.
+    bool try_retire(std::uint32_t index) noexcept;
+
+    // Calls func(thread_state&) for each thread, starting with the threads
+    // in the same partition as thread 'index', beginning at 'index' itself
+    // unless includeSelf is false, followed by the threads of the other
+    // partitions. Stops early and returns true if func returns true.
+    template <typename Func>
+    bool visit_threads(std::uint32_t index, bool includeSelf, Func func) noexcept;
+
+    task_base* try_pop_any(std::uint32_t index) noexcept;
+    task_base* try_steal(std::uint32_t index) noexcept;
+    task_base* try_steal_run_next(std::uint32_t index) noexcept;
+
+    // Take the task in the thread's run-next slot, unless the thread has
+    // already run too many tasks from it in a row. 'streak' counts them.
+    task_base* pop_run_next(thread_state& state, std::uint32_t& streak) noexcept;
+    bool wake_one_sleeper(std::uint32_t index) noexcept;
+
+    // The maximum number of threads. There is a thread_state for each.
     std::uint32_t threadCount_;
+    std::uint32_t minThreadCount_;
+    bool elastic_;
+    std::uint32_t growQueueDepth_;
+    clock_t::duration growWaitTime_;
+    clock_t::duration keepAlive_;
+    bool workStealing_;
+    bool runNext_;
+    idle_strategy idle_;
     std::vector<std::thread> threads_;
     std::vector<thread_state> threadStates_;
-    std::atomic<std::uint32_t> nextThread_;
+    std::vector<thread_range> partitions_;
+    thread_range allThreads_;
+    // Maps a CPU number to the partition whose threads are pinned to it.
+    std::vector<std::uint32_t> cpuPartitions_;
+    std::atomic<std::uint32_t> nextPartition_{0};
+    // Threads that are waiting for work. Only maintained in work-stealing or
+    // elastic mode.
+    std::atomic<std::uint32_t> sleepingCount_{0};
+    // Threads [0, activeThreadCount_) are running. Only changes in elastic
+    // mode, with elasticMutex_ held.
+    std::atomic<std::uint32_t> activeThreadCount_{0};
+    std::mutex elasticMutex_;
+    bool stopping_ = false;
+    // Whether the monitor thread found every queue empty and is waiting for
+    // wake_monitor().
+    std::atomic<bool> monitorIdle_{false};
+    std::condition_variable monitorCv_;
+    std::thread monitor_;
   };
 
   template <typename Receiver>
@@ -148,10 +780,15 @@ namespace _static_thread_pool {
     friend context::scheduler::schedule_sender;
 
     context& pool_;
+    std::uint32_t partition_;
+    priority priority_;
     Receiver receiver_;
 
-    explicit type(context& pool, Receiver&& r)
+    explicit type(
+        context& pool, std::uint32_t partition, priority prio, Receiver&& r)
       : pool_(pool)
+      , partition_(partition)
+      , priority_(prio)
       , receiver_((Receiver &&) r) {
       this->execute = [](task_base* t) noexcept {
         auto& op = *static_cast<type*>(t);
@@ -167,7 +804,7 @@ namespace _static_thread_pool {
     }
 
     void enqueue_(task_base* op) const {
-      pool_.enqueue(op);
+      pool_.enqueue(op, partition_, priority_);
     }
 
     friend void tag_invoke(tag_t<start>, type& op) noexcept {
@@ -175,9 +812,288 @@ namespace _static_thread_pool {
     }
   };
 
+  template <typename Receiver>
+  class _timer_op<Receiver>::type final : timer_task_base {
+    friend context::scheduler::schedule_at_sender;
+
+    template <typename Receiver2>
+    explicit type(
+        context& pool,
+        std::uint32_t partition,
+        priority prio,
+        time_point dueTime,
+        clock_t::duration delay,
+        bool relative,
+        Receiver2&& r)
+      : timer_task_base(pool)
+      , partition_(partition)
+      , delay_(delay)
+      , relative_(relative)
+      , receiver_((Receiver2 &&) r) {
+      this->dueTime_ = dueTime;
+      this->priority_ = prio;
+      this->execute = &type::execute_impl;
+    }
+
+    static void execute_impl(task_base* t) noexcept {
+      auto& op = *static_cast<type*>(t);
+      op.cancelCallback_.destruct();
+      if constexpr (!is_stop_never_possible_v<
+                        stop_token_type_t<Receiver&>>) {
+        if (get_stop_token(op.receiver_).stop_requested()) {
+          unifex::set_done((Receiver &&) op.receiver_);
+          return;
+        }
+      }
+      unifex::set_value((Receiver &&) op.receiver_);
+    }
+
+    std::uint32_t partition_;
+    clock_t::duration delay_;
+    bool relative_;
+    UNIFEX_NO_UNIQUE_ADDRESS Receiver receiver_;
+    UNIFEX_NO_UNIQUE_ADDRESS manual_lifetime<typename stop_token_type_t<
+        Receiver&>::template callback_type<timer_cancel_callback>>
+        cancelCallback_;
+
+  public:
+    void start() noexcept {
+      if (relative_) {
+        this->dueTime_ = clock_t::now() + delay_;
+      }
+      this->timerShard_ = this->pool_.timer_shard_for(partition_);
+      cancelCallback_.construct(
+          get_stop_token(receiver_), timer_cancel_callback{this});
+      this->pool_.add_timer(this);
+    }
+  };
+
+  // Runs a bulk_schedule() operation on the pool.
+  //
+  // If the receiver allows parallel execution then the index space is split
+  // into one contiguous range per worker thread (of the scheduler's partition,
+  // if it has one) and each range is executed
+  // as a separate task. Each task checks the stop token before every chunk
+  // of bulk_cancellation_chunk_size indices. The task that finishes last
+  // delivers the final completion signal.
+  template <typename Integral, typename Receiver>
+  class _bulk_op<Integral, Receiver>::type {
+    friend bulk_schedule_sender<Integral>;
+
+    struct chunk_task : task_base {
+      type* op_;
+      Integral begin_;
+      Integral end_;
+    };
+
+    template <typename Receiver2>
+    explicit type(
+        context& pool,
+        std::uint32_t partition,
+        priority prio,
+        Integral count,
+        Receiver2&& r)
+      : pool_(pool)
+      , partition_(partition)
+      , priority_(prio)
+      , receiver_((Receiver2 &&) r)
+      , taskCount_(task_count(
+            pool.thread_count_for(pool.threads_for(partition)), count))
+      , tasks_(new chunk_task[taskCount_])
+      , remaining_(taskCount_) {
+      // Split [0, count) into taskCount_ ranges whose sizes differ by at
+      // most one.
+      const Integral taskCount = static_cast<Integral>(taskCount_);
+      const Integral base = count / taskCount;
+      const Integral extra = count % taskCount;
+      Integral begin = 0;
+      for (std::uint32_t i = 0; i < taskCount_; ++i) {
+        const Integral size =
+            base + (static_cast<Integral>(i) < extra ? 1 : 0);
+        auto& task = tasks_[i];
+        task.execute = &type::execute_chunk;
+        task.op_ = this;
+        task.begin_ = begin;
+        task.end_ = static_cast<Integral>(begin + size);
+        begin = task.end_;
+      }
+    }
+
+    static std::uint32_t
+    task_count(std::uint32_t threadCount, Integral count) noexcept {
+      const auto chunks = static_cast<std::uint64_t>(count) /
+              bulk_cancellation_chunk_size + 1;
+      return static_cast<std::uint32_t>(std::min<std::uint64_t>(
+          chunks, threadCount));
+    }
+
+    static void execute_chunk(task_base* t) noexcept {
+      auto& task = *static_cast<chunk_task*>(t);
+      auto& op = *task.op_;
+      op.run_chunk(task.begin_, task.end_);
+      if (op.remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        op.complete();
+      }
+    }
+
+    void run_chunk(Integral begin, Integral end) noexcept {
+      auto stopToken = get_stop_token(receiver_);
+      for (Integral chunkStart = begin; chunkStart < end;
+           chunkStart += static_cast<Integral>(bulk_cancellation_chunk_size)) {
+        if (stopToken.stop_requested() ||
+            failed_.load(std::memory_order_relaxed)) {
+          stopped_.store(true, std::memory_order_relaxed);
+          return;
+        }
+        const Integral chunkEnd = std::min<Integral>(
+            chunkStart + static_cast<Integral>(bulk_cancellation_chunk_size),
+            end);
+        if constexpr (is_nothrow_next_receiver_v<Receiver, Integral>) {
+          for (Integral i = chunkStart; i < chunkEnd; ++i) {
+            unifex::set_next(receiver_, Integral(i));
+          }
+        } else {
+          UNIFEX_TRY {
+            for (Integral i = chunkStart; i < chunkEnd; ++i) {
+              unifex::set_next(receiver_, Integral(i));
+            }
+          } UNIFEX_CATCH (...) {
+            if (!failed_.exchange(true, std::memory_order_relaxed)) {
+              error_ = std::current_exception();
+            }
+            return;
+          }
+        }
+      }
+    }
+
+    void complete() noexcept {
+      // The acq_rel decrement of remaining_ makes all other tasks' writes
+      // visible here.
+      if (failed_.load(std::memory_order_relaxed)) {
+        unifex::set_error((Receiver &&) receiver_, std::move(error_));
+      } else if (stopped_.load(std::memory_order_relaxed)) {
+        unifex::set_done((Receiver &&) receiver_);
+      } else if constexpr (is_nothrow_receiver_of_v<Receiver>) {
+        unifex::set_value((Receiver &&) receiver_);
+      } else {
+        UNIFEX_TRY {
+          unifex::set_value((Receiver &&) receiver_);
+        } UNIFEX_CATCH (...) {
+          unifex::set_error((Receiver &&) receiver_, std::current_exception());
+        }
+      }
+    }
+
+    context& pool_;
+    std::uint32_t partition_;
+    priority priority_;
+    Receiver receiver_;
+    std::uint32_t taskCount_;
+    std::unique_ptr<chunk_task[]> tasks_;
+    std::atomic<std::uint32_t> remaining_;
+    std::atomic<bool> stopped_{false};
+    std::atomic<bool> failed_{false};
+    std::exception_ptr error_;
+
+  public:
+    void start() noexcept {
+      // Spread the tasks over the worker threads, starting with whichever
+      // thread the round-robin counter points at.
+      //
+      // Once the last task is enqueued it may run and complete, and the
+      // receiver may destroy this operation, so only locals are used in the
+      // loop.
+      context& pool = pool_;
+      const priority prio = priority_;
+      const std::uint32_t taskCount = taskCount_;
+      chunk_task* const tasks = tasks_.get();
+      auto& threads = pool.threads_for(partition_);
+      const std::uint32_t firstThread = threads.begin_;
+      const std::uint32_t threadCount = pool.thread_count_for(threads);
+      const std::uint32_t startIndex =
+          threads.nextThread_.fetch_add(taskCount, std::memory_order_relaxed);
+      for (std::uint32_t i = 0; i < taskCount; ++i) {
+        pool.enqueue_on(
+            &tasks[i], firstThread + (startIndex + i) % threadCount, prio);
+      }
+    }
+  };
+
+  template <typename Integral>
+  class _bulk_sender<Integral>::type {
+  public:
+    template <
+        template <typename...> class Variant,
+        template <typename...> class Tuple>
+    using value_types = Variant<Tuple<>>;
+
+    template <
+        template <typename...> class Variant,
+        template <typename...> class Tuple>
+    using next_types = Variant<Tuple<Integral>>;
+
+    template <template <typename...> class Variant>
+    using error_types = Variant<std::exception_ptr>;
+
+    static constexpr bool sends_done = true;
+
+  private:
+    template <typename Receiver>
+    using policy_t = decltype(get_execution_policy(UNIFEX_DECLVAL(Receiver&)));
+
+    template <typename Receiver>
+    static constexpr bool is_parallel_v = is_one_of_v<
+        policy_t<Receiver>,
+        parallel_policy,
+        parallel_unsequenced_policy>;
+
+    template <typename Receiver>
+    auto make_operation_(Receiver&& r) const {
+      if constexpr (is_parallel_v<remove_cvref_t<Receiver>>) {
+        return bulk_operation<Integral, Receiver>{
+            pool_, partition_, priority_, count_, (Receiver &&) r};
+      } else {
+        // The receiver requires its set_next() calls to be sequenced so
+        // there is nothing to gain from spreading them over the pool.
+        return unifex::connect(
+            schedule(context::scheduler{pool_, partition_, priority_}),
+            _bulk_schedule::schedule_receiver<Integral, remove_cvref_t<Receiver>>{
+                count_, (Receiver &&) r});
+      }
+    }
+
+    template(typename Receiver)
+      (requires receiver_of<Receiver> AND
+          is_next_receiver_v<Receiver, Integral>)
+    friend auto tag_invoke(tag_t<connect>, type s, Receiver&& r) {
+      return s.make_operation_((Receiver &&) r);
+    }
+
+    friend class context::scheduler;
+
+    explicit type(
+        context& pool,
+        std::uint32_t partition,
+        priority prio,
+        Integral count) noexcept
+      : pool_(pool)
+      , partition_(partition)
+      , priority_(prio)
+      , count_(count) {}
+
+    context& pool_;
+    std::uint32_t partition_;
+    priority priority_;
+    Integral count_;
+  };
+
 } // _static_thread_pool
 
 using static_thread_pool = _static_thread_pool::context;
+using static_thread_pool_options = _static_thread_pool::options;
+using static_thread_pool_priority = _static_thread_pool::priority;
+using static_thread_pool_stats = _static_thread_pool::stats;
 
 } // namespace unifex
 
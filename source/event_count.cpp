@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <unifex/detail/event_count.hpp>
+
+#include <unifex/spin_wait.hpp>
+
+#include <climits>
+#include <thread>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+namespace unifex {
+
+#if defined(__linux__)
+namespace {
+  std::uint32_t* futex_word(std::atomic<std::uint32_t>& word) noexcept {
+    static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t));
+    return reinterpret_cast<std::uint32_t*>(&word);
+  }
+} // namespace
+#endif
+
+void event_count::wait_until(
+    key k, const idle_strategy& idle, clock_t::time_point deadline) noexcept {
+  for (std::uint32_t i = 0; i < idle.spinCount; ++i) {
+    if (epoch_.load(std::memory_order_acquire) != k) {
+      waiters_.fetch_sub(1, std::memory_order_relaxed);
+      return;
+    }
+    spin_loop_pause();
+  }
+
+  for (std::uint32_t i = 0; i < idle.yieldCount; ++i) {
+    if (epoch_.load(std::memory_order_acquire) != k) {
+      waiters_.fetch_sub(1, std::memory_order_relaxed);
+      return;
+    }
+    std::this_thread::yield();
+  }
+
+  if (deadline == clock_t::time_point::max() || clock_t::now() < deadline) {
+    park(k, deadline);
+  }
+  waiters_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+#if defined(__linux__)
+
+void event_count::park(key k, clock_t::time_point deadline) noexcept {
+  // Publish that we are about to block before the kernel re-checks the
+  // epoch. A notifier either sees parked_ != 0 and wakes us or changed the
+  // epoch before the kernel's check, making the futex wait return.
+  parked_.fetch_add(1, std::memory_order_seq_cst);
+  if (deadline == clock_t::time_point::max()) {
+    (void)::syscall(
+        SYS_futex, futex_word(epoch_), FUTEX_WAIT_PRIVATE, k, nullptr);
+  } else {
+    // steady_clock is CLOCK_MONOTONIC, which is what FUTEX_WAIT_BITSET
+    // measures absolute timeouts against.
+    const auto sinceEpoch = deadline.time_since_epoch();
+    const auto secs = std::chrono::duration_cast<std::chrono::seconds>(sinceEpoch);
+    const auto nsecs =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(sinceEpoch - secs);
+    ::timespec ts;
+    ts.tv_sec = static_cast<::time_t>(secs.count());
+    ts.tv_nsec = static_cast<long>(nsecs.count());
+    (void)::syscall(
+        SYS_futex,
+        futex_word(epoch_),
+        FUTEX_WAIT_BITSET_PRIVATE,
+        k,
+        &ts,
+        nullptr,
+        FUTEX_BITSET_MATCH_ANY);
+  }
+  parked_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void event_count::notify_slow(bool all) noexcept {
+  epoch_.fetch_add(1, std::memory_order_seq_cst);
+  if (parked_.load(std::memory_order_seq_cst) != 0) {
+    (void)::syscall(
+        SYS_futex,
+        futex_word(epoch_),
+        FUTEX_WAKE_PRIVATE,
+        all ? INT_MAX : 1,
+        nullptr);
+  }
+}
+
+#else
+
+void event_count::park(key k, clock_t::time_point deadline) noexcept {
+  std::unique_lock lock{mutex_};
+  parked_.fetch_add(1, std::memory_order_seq_cst);
+  while (epoch_.load(std::memory_order_seq_cst) == k) {
+    if (deadline == clock_t::time_point::max()) {
+      cv_.wait(lock);
+    } else if (cv_.wait_until(lock, deadline) == std::cv_status::timeout) {
+      break;
+    }
+  }
+  parked_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void event_count::notify_slow(bool all) noexcept {
+  epoch_.fetch_add(1, std::memory_order_seq_cst);
+  if (parked_.load(std::memory_order_seq_cst) != 0) {
+    // Synchronise with a waiter that has checked the epoch but has not yet
+    // blocked on the condition variable.
+    { std::lock_guard lock{mutex_}; }
+    if (all) {
+      cv_.notify_all();
+    } else {
+      cv_.notify_one();
+    }
+  }
+}
+
+#endif
+
+} // namespace unifex
@@ -25,13 +25,18 @@
 
 #include "io_uring_syscall.hpp"
 
+#include <algorithm>
 #include <cstring>
 #include <system_error>
+#include <vector>
 
 #include <fcntl.h>
+#include <linux/fs.h>
 #include <poll.h>
 #include <sys/eventfd.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
@@ -270,6 +275,24 @@
 // to the completion queue and wake-up the I/O thread which will then acquire
 // the list of remotely scheduled items and add them to the list of
 // ready-to-run operations.
+//
+// If the remote thread is itself the I/O thread of another io_uring_context
+// then, where the kernel supports it, it wakes up the I/O thread by
+// submitting an IORING_OP_MSG_RING to its own ring instead, which posts a
+// completion directly to this context's completion queue without a system
+// call of its own. The eventfd poll stays armed in that case and is reused
+// the next time the I/O thread becomes idle.
+//
+// The I/O thread never has more requests in flight than the in-flight limit,
+// which is at most the size of the completion queue, so that the completions
+// of single-shot requests always fit. Operations that find no room are parked
+// on a queue and submitted in order as completions free up slots. Producers
+// that would rather wait than park can use wait_for_capacity().
+//
+// Multishot requests and messages from other rings can still post more
+// completions than fit. The kernel then holds on to them and sets
+// IORING_SQ_CQ_OVERFLOW, and the I/O thread flushes them into the completion
+// queue with io_uring_enter(IORING_ENTER_GETEVENTS) once it has drained it.
 
 namespace unifex::linuxos {
 
@@ -277,13 +300,37 @@ static thread_local io_uring_context* currentThreadContext;
 
 static constexpr __u64 remote_queue_event_user_data = 0;
 
-io_uring_context::io_uring_context() {
+// The user_data of the completions that IORING_OP_MSG_RING requests from
+// other rings post to this ring's completion queue.
+static constexpr __u64 remote_queue_message_user_data = 2;
+
+io_uring_context::io_uring_context() : io_uring_context(options{}) {}
+
+io_uring_context::io_uring_context(const options& opts)
+  : sqPoll_(opts.sqPoll), ioPoll_(opts.ioPoll) {
   io_uring_params params;
   std::memset(&params, 0, sizeof(params));
 
-  int ret = io_uring_setup(256, &params);
+  if (opts.cqEntries != 0) {
+    params.flags |= IORING_SETUP_CQSIZE;
+    params.cq_entries = opts.cqEntries;
+  }
+  if (opts.sqPoll) {
+    params.flags |= IORING_SETUP_SQPOLL;
+    params.sq_thread_idle = static_cast<__u32>(opts.sqPollIdle.count());
+    if (opts.sqPollCpu >= 0) {
+      params.flags |= IORING_SETUP_SQ_AFF;
+      params.sq_thread_cpu = static_cast<__u32>(opts.sqPollCpu);
+    }
+  }
+  if (opts.ioPoll) {
+    params.flags |= IORING_SETUP_IOPOLL;
+  }
+
+  int ret = io_uring_setup(opts.sqEntries, &params);
   if (ret < 0) {
-    throw_(std::system_error{-ret, std::system_category()});
+    int errorCode = errno;
+    throw_(std::system_error{errorCode, std::system_category()});
   }
   iouringFd_ = safe_file_descriptor{ret};
 
@@ -312,6 +359,12 @@ io_uring_context::io_uring_context() {
             params.cq_off.ring_entries)); // Is this a valid assumption?
     cqMask_ = *reinterpret_cast<unsigned*>(cqBlock + params.cq_off.ring_mask);
     UNIFEX_ASSERT(cqMask_ == (cqEntryCount_ - 1));
+    inFlightLimit_ = cqEntryCount_ > reserved_cq_entries
+        ? cqEntryCount_ - reserved_cq_entries
+        : 1;
+    if (opts.maxInFlight != 0) {
+      inFlightLimit_ = std::min(opts.maxInFlight, inFlightLimit_);
+    }
     cqHead_ =
         reinterpret_cast<std::atomic<unsigned>*>(cqBlock + params.cq_off.head);
     cqTail_ =
@@ -386,6 +439,23 @@ io_uring_context::io_uring_context() {
     remoteQueueEventFd_ = safe_file_descriptor{fd};
   }
 
+  {
+    // Remote threads that are themselves running an io_uring_context wake
+    // this one with IORING_OP_MSG_RING (Linux 5.18) when both rings support
+    // it, rather than by writing to the eventfd.
+    constexpr unsigned probeOpCount = 256;
+    std::vector<std::byte> probeBuffer(
+        sizeof(io_uring_probe) + probeOpCount * sizeof(io_uring_probe_op));
+    auto* probe = reinterpret_cast<io_uring_probe*>(probeBuffer.data());
+    auto* probeOps = reinterpret_cast<io_uring_probe_op*>(
+        probeBuffer.data() + sizeof(io_uring_probe));
+    int result = io_uring_register(
+        iouringFd_.get(), IORING_REGISTER_PROBE, probe, probeOpCount);
+    msgRingSupported_ = !ioPoll_ && result >= 0 &&
+        IORING_OP_MSG_RING < probe->ops_len &&
+        (probeOps[IORING_OP_MSG_RING].flags & IO_URING_OP_SUPPORTED) != 0;
+  }
+
   LOG("io_uring_context construction done");
 }
 
@@ -411,6 +481,11 @@ void io_uring_context::run_impl(const bool& shouldStop) {
     // Check for any new completion-queue items.
     acquire_completion_queue_items();
 
+    if ((sqFlags_->load(std::memory_order_acquire) & IORING_SQ_CQ_OVERFLOW) !=
+        0) {
+      flush_overflowed_completions();
+    }
+
     if (timersAreDirty_) {
       update_timers();
     }
@@ -423,16 +498,33 @@ void io_uring_context::run_impl(const bool& shouldStop) {
       acquire_remote_queued_items();
     }
 
+    // Cancellations go first as they are what frees up room under the
+    // in-flight limit. Each one is tried once per pass, since one that still
+    // doesn't fit queues itself again.
+    if (!pendingCancelQueue_.empty() && sqUnflushedCount_ < sqEntryCount_) {
+      auto pending = std::move(pendingCancelQueue_);
+      while (!pending.empty()) {
+        auto* item = pending.pop_front();
+        item->execute_(item);
+      }
+    }
+
     // Process additional I/O requests that were waiting for
     // additional space either in the submission queue or the completion queue.
-    while (!pendingIoQueue_.empty() && can_submit_io()) {
+    // Stop at one that needs more room than there is, rather than letting
+    // those behind it overtake it.
+    pendingIoStalled_ = false;
+    while (!pendingIoStalled_ && !pendingIoQueue_.empty() && can_submit_io()) {
       auto* item = pendingIoQueue_.pop_front();
       item->execute_(item);
     }
 
     if (localQueue_.empty() || sqUnflushedCount_ > 0) {
-      const bool isIdle = sqUnflushedCount_ == 0 && localQueue_.empty();
-      if (isIdle) {
+      // With SQPOLL the kernel thread consumes entries as soon as they are
+      // published so there is never anything left for us to flush.
+      const bool isIdle =
+          (sqPoll_ || sqUnflushedCount_ == 0) && localQueue_.empty();
+      if (isIdle && !ioPoll_) {
         if (!remoteQueueReadSubmitted_) {
           LOG("try_register_remote_queue_notification()");
           remoteQueueReadSubmitted_ = try_register_remote_queue_notification();
@@ -443,41 +535,257 @@ void io_uring_context::run_impl(const bool& shouldStop) {
       unsigned flags = 0;
       if (isIdle &&
           (remoteQueueReadSubmitted_ ||
-           pending_operation_count() == cqEntryCount_)) {
+           pending_operation_count() >= inFlightLimit_)) {
         // No work to do until we receive a completion event.
         minCompletionCount = 1;
         flags = IORING_ENTER_GETEVENTS;
       }
 
+      unsigned submitCount = sqUnflushedCount_;
+      if (sqPoll_) {
+        cqPendingCount_ += sqUnflushedCount_;
+        sqUnflushedCount_ = 0;
+        submitCount = 0;
+
+        // Order the store to the SQ tail before the load of the SQ flags
+        // so that we cannot miss the kernel thread going to sleep.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if ((sqFlags_->load(std::memory_order_relaxed) &
+             IORING_SQ_NEED_WAKEUP) != 0) {
+          flags |= IORING_ENTER_SQ_WAKEUP;
+        }
+      } else if (ioPoll_ && cqPendingCount_ > 0) {
+        // Completions of polled I/O are only reaped by io_uring_enter().
+        flags |= IORING_ENTER_GETEVENTS;
+      }
+
+      if (submitCount == 0 && flags == 0) {
+        // Nothing to submit and nothing to wait for.
+        continue;
+      }
+
       LOGX(
           "io_uring_enter() - submit %u, wait for %i, pending %u\n",
-          sqUnflushedCount_,
+          submitCount,
           minCompletionCount,
           pending_operation_count());
 
       int result = io_uring_enter(
-          iouringFd_.get(),
-          sqUnflushedCount_,
-          minCompletionCount,
-          flags,
-          nullptr);
+          iouringFd_.get(), submitCount, minCompletionCount, flags, nullptr);
       if (result < 0) {
         int errorCode = errno;
+        if (errorCode == EBUSY || errorCode == EAGAIN || errorCode == EINTR) {
+          // The kernel refuses new requests while it holds on to
+          // completions that did not fit in the completion queue (EBUSY),
+          // or is short of memory for them (EAGAIN). Either way, reaping
+          // completions makes room, so go round the loop again.
+          LOGX("io_uring_enter() failed with %i, retrying\n", errorCode);
+          if (errorCode != EINTR) {
+            increment(busyRetryCount_);
+          }
+          continue;
+        }
         throw_(std::system_error{errorCode, std::system_category()});
       }
 
       LOG("io_uring_enter() returned");
 
-      sqUnflushedCount_ -= result;
-      cqPendingCount_ += result;
+      if (!sqPoll_) {
+        sqUnflushedCount_ -= result;
+        cqPendingCount_ += result;
+      }
     }
   }
 }
 
+io_uring_context::statistics
+io_uring_context::get_statistics() const noexcept {
+  statistics stats;
+  stats.submitted = submittedCount_.load(std::memory_order_relaxed);
+  stats.completed = completedCount_.load(std::memory_order_relaxed);
+  stats.deferred = deferredCount_.load(std::memory_order_relaxed);
+  stats.overflowFlushes = overflowFlushCount_.load(std::memory_order_relaxed);
+  // Maintained by the kernel.
+  stats.droppedCompletions = cqOverflow_->load(std::memory_order_relaxed);
+  stats.busyRetries = busyRetryCount_.load(std::memory_order_relaxed);
+  return stats;
+}
+
 bool io_uring_context::is_running_on_io_thread() const noexcept {
   return this == currentThreadContext;
 }
 
+void io_uring_context::register_buffers(span<const iovec> buffers) {
+  UNIFEX_ASSERT(registeredBuffers_.empty());
+
+  std::vector<registered_buffer> registeredBuffers;
+  registeredBuffers.reserve(buffers.size());
+  for (std::size_t i = 0; i < buffers.size(); ++i) {
+    const auto begin = reinterpret_cast<std::uintptr_t>(buffers[i].iov_base);
+    registeredBuffers.push_back(
+        {begin, begin + buffers[i].iov_len, static_cast<int>(i)});
+  }
+  std::sort(
+      registeredBuffers.begin(),
+      registeredBuffers.end(),
+      [](const registered_buffer& a, const registered_buffer& b) noexcept {
+        return a.begin_ < b.begin_;
+      });
+
+  int result = io_uring_register(
+      iouringFd_.get(),
+      IORING_REGISTER_BUFFERS,
+      buffers.data(),
+      static_cast<unsigned>(buffers.size()));
+  if (result < 0) {
+    int errorCode = errno;
+    throw_(std::system_error{errorCode, std::system_category()});
+  }
+
+  registeredBuffers_ = std::move(registeredBuffers);
+}
+
+void io_uring_context::unregister_buffers() {
+  int result = io_uring_register(
+      iouringFd_.get(), IORING_UNREGISTER_BUFFERS, nullptr, 0);
+  if (result < 0) {
+    int errorCode = errno;
+    throw_(std::system_error{errorCode, std::system_category()});
+  }
+
+  registeredBuffers_.clear();
+}
+
+int io_uring_context::find_registered_buffer(
+    const void* data, std::size_t size) const noexcept {
+  if (registeredBuffers_.empty()) {
+    return -1;
+  }
+
+  // Find the last buffer that starts at or before 'data'.
+  const auto begin = reinterpret_cast<std::uintptr_t>(data);
+  auto it = std::upper_bound(
+      registeredBuffers_.begin(),
+      registeredBuffers_.end(),
+      begin,
+      [](std::uintptr_t address, const registered_buffer& buffer) noexcept {
+        return address < buffer.begin_;
+      });
+  if (it == registeredBuffers_.begin()) {
+    return -1;
+  }
+  --it;
+
+  if (begin > it->end_ || size > it->end_ - begin) {
+    return -1;
+  }
+  return it->index_;
+}
+
+void io_uring_context::register_files(std::uint32_t slotCount) {
+  UNIFEX_ASSERT(fileSlotCount_ == 0 && slotCount > 0);
+
+  // Register a sparse table. Slots are filled in as files are opened.
+  std::vector<int> fds(slotCount, -1);
+  int result = io_uring_register(
+      iouringFd_.get(), IORING_REGISTER_FILES, fds.data(), slotCount);
+  if (result < 0) {
+    int errorCode = errno;
+    throw_(std::system_error{errorCode, std::system_category()});
+  }
+
+  // Hand out the lowest slots first.
+  std::lock_guard lock{fileSlotMutex_};
+  freeFileSlots_.reserve(slotCount);
+  for (std::uint32_t i = slotCount; i > 0; --i) {
+    freeFileSlots_.push_back(static_cast<int>(i - 1));
+  }
+  fileSlotCount_ = slotCount;
+}
+
+void io_uring_context::unregister_files() {
+  {
+    std::lock_guard lock{fileSlotMutex_};
+    UNIFEX_ASSERT(freeFileSlots_.size() == fileSlotCount_);
+    freeFileSlots_.clear();
+    fileSlotCount_ = 0;
+  }
+
+  int result =
+      io_uring_register(iouringFd_.get(), IORING_UNREGISTER_FILES, nullptr, 0);
+  if (result < 0) {
+    int errorCode = errno;
+    throw_(std::system_error{errorCode, std::system_category()});
+  }
+}
+
+io_uring_context::file_slot io_uring_context::try_register_file(
+    int fd) noexcept {
+  int index;
+  {
+    std::lock_guard lock{fileSlotMutex_};
+    if (freeFileSlots_.empty()) {
+      return {};
+    }
+    index = freeFileSlots_.back();
+    freeFileSlots_.pop_back();
+  }
+
+  io_uring_files_update update;
+  std::memset(&update, 0, sizeof(update));
+  update.offset = static_cast<__u32>(index);
+  update.fds = reinterpret_cast<std::uintptr_t>(&fd);
+  int result = io_uring_register(
+      iouringFd_.get(), IORING_REGISTER_FILES_UPDATE, &update, 1);
+  if (result < 0) {
+    // Fall back to using the file descriptor.
+    std::lock_guard lock{fileSlotMutex_};
+    freeFileSlots_.push_back(index);
+    return {};
+  }
+
+  return file_slot{*this, index};
+}
+
+void io_uring_context::unregister_file(int index) noexcept {
+  io_uring_files_update update;
+  std::memset(&update, 0, sizeof(update));
+  const int fd = -1;
+  update.offset = static_cast<__u32>(index);
+  update.fds = reinterpret_cast<std::uintptr_t>(&fd);
+  (void)io_uring_register(
+      iouringFd_.get(), IORING_REGISTER_FILES_UPDATE, &update, 1);
+
+  std::lock_guard lock{fileSlotMutex_};
+  freeFileSlots_.push_back(index);
+}
+
+io_uring_context::dio_alignment
+io_uring_context::query_dio_alignment(int fd) noexcept {
+#ifdef STATX_DIOALIGN
+  // Zero alignments mean that the file does not support direct I/O, or that
+  // the kernel predates STATX_DIOALIGN.
+  struct statx buffer;
+  if (::statx(fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &buffer) == 0 &&
+      (buffer.stx_mask & STATX_DIOALIGN) != 0 &&
+      buffer.stx_dio_mem_align != 0 && buffer.stx_dio_offset_align != 0) {
+    return dio_alignment{
+        buffer.stx_dio_mem_align, buffer.stx_dio_offset_align};
+  }
+#endif
+
+  struct stat status;
+  int sectorSize = 0;
+  if (::fstat(fd, &status) == 0 && S_ISBLK(status.st_mode) &&
+      ::ioctl(fd, BLKSSZGET, &sectorSize) == 0 && sectorSize > 0) {
+    const auto alignment = static_cast<std::uint32_t>(sectorSize);
+    return dio_alignment{alignment, alignment};
+  }
+
+  const auto pageSize = static_cast<std::uint32_t>(sysconf(_SC_PAGESIZE));
+  return dio_alignment{pageSize, pageSize};
+}
+
 void io_uring_context::schedule_impl(operation_base* op) {
   UNIFEX_ASSERT(op != nullptr);
   if (is_running_on_io_thread()) {
@@ -500,19 +808,35 @@ void io_uring_context::schedule_remote(operation_base* op) noexcept {
   if (ioThreadWasInactive) {
     // We were the first to queue an item and the I/O thread is not
     // going to check the queue until we signal it that new items
-    // have been enqueued remotely by writing to the eventfd.
-    signal_remote_queue();
+    // have been enqueued remotely, either by a message from the ring of
+    // the calling thread or by writing to the eventfd.
+    if (!try_message_remote_queue()) {
+      signal_remote_queue();
+    }
   }
 }
 
 void io_uring_context::schedule_pending_io(operation_base* op) noexcept {
   UNIFEX_ASSERT(is_running_on_io_thread());
+  increment(deferredCount_);
   pendingIoQueue_.push_back(op);
 }
 
 void io_uring_context::reschedule_pending_io(operation_base* op) noexcept {
   UNIFEX_ASSERT(is_running_on_io_thread());
   pendingIoQueue_.push_front(op);
+  pendingIoStalled_ = true;
+}
+
+void io_uring_context::remove_pending_io(operation_base* op) noexcept {
+  UNIFEX_ASSERT(is_running_on_io_thread());
+  pendingIoQueue_.remove(op);
+}
+
+void io_uring_context::schedule_pending_cancel(operation_base* op) noexcept {
+  UNIFEX_ASSERT(is_running_on_io_thread());
+  increment(deferredCount_);
+  pendingCancelQueue_.push_back(op);
 }
 
 void io_uring_context::schedule_at_impl(schedule_at_operation* op) noexcept {
@@ -560,6 +884,12 @@ void io_uring_context::acquire_completion_queue_items() noexcept {
 
     operation_queue completionQueue;
 
+    // Completions of multishot requests that are still pending.
+    std::uint32_t moreCount = 0;
+
+    // Completions posted by other rings, which we never submitted.
+    std::uint32_t messageCount = 0;
+
     for (std::uint32_t i = 0; i < count; ++i) {
       auto& cqe = cqEntries_[(cqHead + i) & mask];
 
@@ -589,8 +919,27 @@ void io_uring_context::acquire_completion_queue_items() noexcept {
 
         // Skip processing this item and let the loop check
         // for the remote-queued items next time around.
+        remoteQueuePollSubmitted_ = false;
+        remoteQueueReadSubmitted_ = false;
+        continue;
+      } else if (cqe.user_data == remote_queue_message_user_data) {
+        LOG("got remote queue message");
+        ++messageCount;
+
+        // As for the eventfd, except that the poll is still armed.
         remoteQueueReadSubmitted_ = false;
         continue;
+      } else if ((cqe.user_data & message_user_data_tag) != 0) {
+        if (cqe.res < 0) {
+          // The message was not delivered so the other ring would never
+          // wake up. Fall back to its eventfd.
+          LOGX("remote queue message failed err: %i\n", cqe.res);
+          auto* target = reinterpret_cast<io_uring_context*>(
+              static_cast<std::uintptr_t>(cqe.user_data) &
+              ~message_user_data_tag);
+          target->signal_remote_queue();
+        }
+        continue;
       } else if (cqe.user_data == timer_user_data()) {
         LOGX("got timer completion result %i\n", cqe.res);
         UNIFEX_ASSERT(activeTimerCount_ > 0);
@@ -610,6 +959,19 @@ void io_uring_context::acquire_completion_queue_items() noexcept {
       } else if (cqe.user_data == remove_timer_user_data()) {
         // Ignore timer cancellation completion.
         continue;
+      } else if (cqe.user_data == cancel_user_data()) {
+        // Ignore I/O cancellation completion. The cancelled operation
+        // receives its own completion.
+        continue;
+      } else if ((cqe.user_data & multishot_user_data_tag) != 0) {
+        auto* op = reinterpret_cast<multishot_base*>(
+            static_cast<std::uintptr_t>(cqe.user_data) &
+            ~multishot_user_data_tag);
+        if ((cqe.flags & IORING_CQE_F_MORE) != 0) {
+          ++moreCount;
+        }
+        op->complete_(op, cqe.res, cqe.flags);
+        continue;
       }
 
       auto& completionState = *reinterpret_cast<completion_base*>(
@@ -626,10 +988,24 @@ void io_uring_context::acquire_completion_queue_items() noexcept {
 
     // Mark those completion queue entries as consumed.
     cqHead_->store(cqTail, std::memory_order_release);
-    cqPendingCount_ -= count;
+    cqPendingCount_ -= count - moreCount - messageCount;
+    increment(completedCount_, count);
   }
 }
 
+void io_uring_context::flush_overflowed_completions() noexcept {
+  // With IORING_FEAT_NODROP (Linux 5.5) the kernel queues completions that
+  // did not fit rather than dropping them, and moves them into the
+  // completion queue on the next io_uring_enter() with GETEVENTS. Multishot
+  // requests and messages from other rings are not bounded by the in-flight
+  // limit, so they can get there.
+  LOG("completion queue overflowed, flushing");
+  increment(overflowFlushCount_);
+  (void)io_uring_enter(
+      iouringFd_.get(), 0, 0, IORING_ENTER_GETEVENTS, nullptr);
+  acquire_completion_queue_items();
+}
+
 void io_uring_context::acquire_remote_queued_items() noexcept {
   UNIFEX_ASSERT(!remoteQueueReadSubmitted_);
   auto items = remoteQueue_.dequeue_all();
@@ -639,6 +1015,17 @@ void io_uring_context::acquire_remote_queued_items() noexcept {
 }
 
 bool io_uring_context::try_register_remote_queue_notification() noexcept {
+  if (remoteQueuePollSubmitted_) {
+    // We were last woken up by a message so the eventfd poll is still
+    // armed and only the queue needs to be marked inactive.
+    auto queuedItems = remoteQueue_.try_mark_inactive_or_dequeue_all();
+    if (!queuedItems.empty()) {
+      schedule_local(std::move(queuedItems));
+      return false;
+    }
+    return true;
+  }
+
   // Check that we haven't already hit the limit of pending
   // I/O completion events.
   const auto populateRemoteQueuePollSqe = [this](io_uring_sqe & sqe) noexcept {
@@ -656,14 +1043,64 @@ bool io_uring_context::try_register_remote_queue_notification() noexcept {
     return true;
   };
 
-  if (try_submit_io(populateRemoteQueuePollSqe)) {
+  if (try_submit_unlimited_io(populateRemoteQueuePollSqe)) {
     LOG("added eventfd poll to submission queue");
+    remoteQueuePollSubmitted_ = true;
     return true;
   }
 
   return false;
 }
 
+bool io_uring_context::try_message_remote_queue() noexcept {
+  io_uring_context* source = currentThreadContext;
+  if (source == nullptr || source == this || !msgRingSupported_ ||
+      !source->msgRingSupported_) {
+    return false;
+  }
+
+  const bool queued =
+      source->try_submit_unlimited_io([this](io_uring_sqe & sqe) noexcept {
+        sqe.opcode = IORING_OP_MSG_RING;
+        sqe.fd = iouringFd_.get();
+        sqe.off = remote_queue_message_user_data;
+        sqe.user_data =
+            reinterpret_cast<std::uintptr_t>(this) | message_user_data_tag;
+        LOG("added remote queue message to submission queue");
+      });
+
+  // If the message stays behind in the submission queue, the caller writes
+  // the eventfd instead and the message is a spare wakeup once it is sent.
+  return queued && source->flush_submission_queue();
+}
+
+bool io_uring_context::flush_submission_queue() noexcept {
+  if (sqPoll_) {
+    cqPendingCount_ += sqUnflushedCount_;
+    sqUnflushedCount_ = 0;
+
+    // Order the store to the SQ tail before the load of the SQ flags
+    // so that we cannot miss the kernel thread going to sleep.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if ((sqFlags_->load(std::memory_order_relaxed) & IORING_SQ_NEED_WAKEUP) ==
+        0) {
+      return true;
+    }
+    return io_uring_enter(
+               iouringFd_.get(), 0, 0, IORING_ENTER_SQ_WAKEUP, nullptr) >= 0;
+  }
+
+  const int result =
+      io_uring_enter(iouringFd_.get(), sqUnflushedCount_, 0, 0, nullptr);
+  if (result < 0) {
+    // Left for the run loop, which retries.
+    return false;
+  }
+  sqUnflushedCount_ -= result;
+  cqPendingCount_ += result;
+  return sqUnflushedCount_ == 0;
+}
+
 void io_uring_context::signal_remote_queue() {
   LOG("writing bytes to eventfd");
 
@@ -723,6 +1160,13 @@ void io_uring_context::update_timers() noexcept {
     }
   }
 
+  if (ioPoll_) {
+    // Timeouts cannot be submitted to a polled ring. Keep checking the
+    // timers each time around the run loop instead.
+    timersAreDirty_ = !timers_.empty();
+    return;
+  }
+
   // Check if we need to cancel or start some new OS timers.
   if (timers_.empty()) {
     if (currentDueTime_.has_value()) {
@@ -778,7 +1222,7 @@ bool io_uring_context::try_submit_timer_io(const time_point& dueTime) noexcept {
     time_.tv_nsec = dueTime.nanoseconds_part();
   };
 
-  if (try_submit_io(populateSqe)) {
+  if (try_submit_unlimited_io(populateSqe)) {
     ++activeTimerCount_;
     return true;
   }
@@ -793,46 +1237,268 @@ bool io_uring_context::try_submit_timer_io_cancel() noexcept {
     sqe.user_data = remove_timer_user_data();
   };
 
-  return try_submit_io(populateSqe);
+  return try_submit_unlimited_io(populateSqe);
+}
+
+io_uring_context::aligned_buffer_pool::aligned_buffer_pool(
+    std::size_t bufferSize,
+    std::size_t bufferCount,
+    std::size_t alignment)
+  : alignment_(alignment),
+    bufferSize_((bufferSize + alignment - 1) & ~(alignment - 1)),
+    bufferCount_(bufferCount) {
+  UNIFEX_ASSERT(bufferSize > 0 && bufferCount > 0);
+  UNIFEX_ASSERT(alignment > 0 && (alignment & (alignment - 1)) == 0);
+  UNIFEX_ASSERT(alignment <= static_cast<std::size_t>(sysconf(_SC_PAGESIZE)));
+
+  // The region is page-aligned, so every buffer is aligned as long as its
+  // size is a multiple of the alignment.
+  const std::size_t size = bufferSize_ * bufferCount;
+  void* ptr = mmap(
+      nullptr,
+      size,
+      PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE,
+      -1,
+      0);
+  if (ptr == MAP_FAILED) {
+    int errorCode = errno;
+    throw_(std::system_error{errorCode, std::system_category()});
+  }
+  region_ = mmap_region{ptr, size};
+
+  // Hand out the lowest addresses first.
+  freeBuffers_.reserve(bufferCount);
+  for (std::size_t i = bufferCount; i > 0; --i) {
+    freeBuffers_.push_back(i - 1);
+  }
+}
+
+io_uring_context::aligned_buffer_pool::~aligned_buffer_pool() {
+  UNIFEX_ASSERT(freeBuffers_.size() == bufferCount_);
+}
+
+span<std::byte> io_uring_context::aligned_buffer_pool::allocate() noexcept {
+  std::size_t index;
+  {
+    std::lock_guard lock{mutex_};
+    if (freeBuffers_.empty()) {
+      return {};
+    }
+    index = freeBuffers_.back();
+    freeBuffers_.pop_back();
+  }
+  return span{
+      static_cast<std::byte*>(region_.data()) + index * bufferSize_,
+      bufferSize_};
+}
+
+void io_uring_context::aligned_buffer_pool::deallocate(
+    span<std::byte> buffer) noexcept {
+  const auto offset = static_cast<std::size_t>(
+      buffer.data() - static_cast<std::byte*>(region_.data()));
+  UNIFEX_ASSERT(offset % bufferSize_ == 0);
+  UNIFEX_ASSERT(offset / bufferSize_ < bufferCount_);
+
+  std::lock_guard lock{mutex_};
+  freeBuffers_.push_back(offset / bufferSize_);
+}
+
+io_uring_context::registered_buffer_pool::registered_buffer_pool(
+    io_uring_context& context,
+    std::size_t bufferSize,
+    std::size_t bufferCount,
+    std::size_t alignment)
+  : aligned_buffer_pool(bufferSize, bufferCount, alignment),
+    context_(context) {
+  const iovec buffer{region().data(), region().size()};
+  context_.register_buffers(span<const iovec>{&buffer, 1});
+}
+
+io_uring_context::registered_buffer_pool::~registered_buffer_pool() {
+  UNIFEX_TRY {
+    context_.unregister_buffers();
+  } UNIFEX_CATCH (...) {
+    // Unregistering can only fail if the ring is gone, in which case the
+    // registration has been dropped along with it.
+  }
+}
+
+io_uring_context::provided_buffer_ring::provided_buffer_ring(
+    io_uring_context& context,
+    std::size_t bufferSize,
+    std::uint16_t bufferCount)
+  : context_(context),
+    bufferSize_(bufferSize),
+    bufferCount_(bufferCount),
+    groupId_(context.nextBufferGroup_.fetch_add(1, std::memory_order_relaxed)) {
+  UNIFEX_ASSERT(bufferSize > 0);
+  UNIFEX_ASSERT(bufferCount > 0 && bufferCount <= 32768);
+  UNIFEX_ASSERT((bufferCount & (bufferCount - 1)) == 0);
+
+  // The ring must be page-aligned, which the buffers following it then are
+  // too.
+  const std::size_t pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+  const std::size_t ringSize =
+      (bufferCount * sizeof(io_uring_buf) + pageSize - 1) & ~(pageSize - 1);
+  const std::size_t size = ringSize + bufferSize * bufferCount;
+  void* ptr = mmap(
+      nullptr,
+      size,
+      PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE,
+      -1,
+      0);
+  if (ptr == MAP_FAILED) {
+    int errorCode = errno;
+    throw_(std::system_error{errorCode, std::system_category()});
+  }
+  region_ = mmap_region{ptr, size};
+  ring_ = static_cast<io_uring_buf_ring*>(ptr);
+  buffers_ = static_cast<std::byte*>(ptr) + ringSize;
+
+  io_uring_buf_reg reg;
+  std::memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = reinterpret_cast<std::uintptr_t>(ptr);
+  reg.ring_entries = bufferCount;
+  reg.bgid = groupId_;
+  int result = io_uring_register(
+      context_.iouringFd_.get(), IORING_REGISTER_PBUF_RING, &reg, 1);
+  if (result < 0) {
+    int errorCode = errno;
+    throw_(std::system_error{errorCode, std::system_category()});
+  }
+
+  for (std::uint16_t id = 0; id < bufferCount; ++id) {
+    recycle(id);
+  }
+}
+
+io_uring_context::provided_buffer_ring::~provided_buffer_ring() {
+  io_uring_buf_reg reg;
+  std::memset(&reg, 0, sizeof(reg));
+  reg.bgid = groupId_;
+  // Can only fail if the ring is gone, in which case the registration has
+  // been dropped along with it.
+  (void)io_uring_register(
+      context_.iouringFd_.get(), IORING_UNREGISTER_PBUF_RING, &reg, 1);
+}
+
+void io_uring_context::provided_buffer_ring::recycle(
+    std::uint16_t id) noexcept {
+  std::lock_guard lock{mutex_};
+  // Not ring_->bufs, which the kernel header declares in a way that C++ lays
+  // out one entry further along.
+  auto& entry =
+      reinterpret_cast<io_uring_buf*>(ring_)[tail_ & (bufferCount_ - 1)];
+  entry.addr = reinterpret_cast<std::uintptr_t>(buffer(id));
+  entry.len = static_cast<__u32>(bufferSize_);
+  entry.bid = id;
+
+  // The kernel reads the tail, which overlays the first entry, without
+  // taking the lock.
+  ++tail_;
+  reinterpret_cast<std::atomic<std::uint16_t>*>(&ring_->tail)
+      ->store(tail_, std::memory_order_release);
 }
 
 io_uring_context::async_read_only_file tag_invoke(
     tag_t<open_file_read_only>,
     io_uring_context::scheduler scheduler,
     const filesystem::path& path) {
-  int result = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  return open_file_read_only(scheduler, path, open_file_options{});
+}
+
+io_uring_context::async_read_only_file tag_invoke(
+    tag_t<open_file_read_only>,
+    io_uring_context::scheduler scheduler,
+    const filesystem::path& path,
+    const open_file_options& options) {
+  const int flags = io_uring_context::scheduler::open_flags(options);
+  int result = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | flags);
   if (result < 0) {
     int errorCode = errno;
     throw_(std::system_error{errorCode, std::system_category()});
   }
 
-  return io_uring_context::async_read_only_file{*scheduler.context_, result};
+  return io_uring_context::async_read_only_file{
+      *scheduler.context_, result, options.direct};
 }
 
 io_uring_context::async_write_only_file tag_invoke(
     tag_t<open_file_write_only>,
     io_uring_context::scheduler scheduler,
     const filesystem::path& path) {
-  int result = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+  return open_file_write_only(scheduler, path, open_file_options{});
+}
+
+io_uring_context::async_write_only_file tag_invoke(
+    tag_t<open_file_write_only>,
+    io_uring_context::scheduler scheduler,
+    const filesystem::path& path,
+    const open_file_options& options) {
+  const int flags = io_uring_context::scheduler::open_flags(options);
+  int result = ::open(
+      path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | flags, 0644);
   if (result < 0) {
     int errorCode = errno;
     throw_(std::system_error{errorCode, std::system_category()});
   }
 
-  return io_uring_context::async_write_only_file{*scheduler.context_, result};
+  return io_uring_context::async_write_only_file{
+      *scheduler.context_, result, options.direct};
 }
 
 io_uring_context::async_read_write_file tag_invoke(
     tag_t<open_file_read_write>,
     io_uring_context::scheduler scheduler,
     const filesystem::path& path) {
-  int result = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  return open_file_read_write(scheduler, path, open_file_options{});
+}
+
+io_uring_context::async_read_write_file tag_invoke(
+    tag_t<open_file_read_write>,
+    io_uring_context::scheduler scheduler,
+    const filesystem::path& path,
+    const open_file_options& options) {
+  const int flags = io_uring_context::scheduler::open_flags(options);
+  int result = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC | flags, 0644);
   if (result < 0) {
     int errorCode = errno;
     throw_(std::system_error{errorCode, std::system_category()});
   }
 
-  return io_uring_context::async_read_write_file{*scheduler.context_, result};
+  return io_uring_context::async_read_write_file{
+      *scheduler.context_, result, options.direct};
+}
+
+io_uring_context::async_socket tag_invoke(
+    tag_t<open_socket>,
+    io_uring_context::scheduler scheduler,
+    int domain,
+    int type,
+    int protocol) {
+  int result = ::socket(domain, type | SOCK_CLOEXEC, protocol);
+  if (result < 0) {
+    int errorCode = errno;
+    throw_(std::system_error{errorCode, std::system_category()});
+  }
+
+  return io_uring_context::async_socket{*scheduler.context_, result};
+}
+
+std::pair<io_uring_context::async_reader, io_uring_context::async_writer>
+tag_invoke(tag_t<open_pipe>, io_uring_context::scheduler scheduler) {
+  int fd[2] = {};
+  int result = ::pipe2(fd, O_CLOEXEC);
+  if (result < 0) {
+    int errorCode = errno;
+    throw_(std::system_error{errorCode, std::system_category(), "pipe2"});
+  }
+
+  return {
+      io_uring_context::async_reader{*scheduler.context_, fd[0]},
+      io_uring_context::async_writer{*scheduler.context_, fd[1]}};
 }
 
 } // namespace unifex::linuxos
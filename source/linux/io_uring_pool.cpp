@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <unifex/config.hpp>
+
+#if !UNIFEX_NO_LIBURING
+
+#include <unifex/linux/io_uring_pool.hpp>
+
+#include <unifex/detail/thread_affinity.hpp>
+
+namespace unifex::linuxos {
+
+// The pool and ring index of the current thread if it is one of an
+// io_uring_pool's threads.
+static thread_local io_uring_pool* currentThreadPool = nullptr;
+static thread_local std::uint32_t currentThreadRing = 0;
+
+io_uring_pool::io_uring_pool() : io_uring_pool(options{}) {}
+
+io_uring_pool::io_uring_pool(const options& opts) {
+  const auto cpus = _thread_affinity::allowed_cpus();
+  std::uint32_t ringCount = opts.ringCount;
+  if (ringCount == 0) {
+    ringCount = cpus.empty() ? std::thread::hardware_concurrency()
+                             : static_cast<std::uint32_t>(cpus.size());
+  }
+  if (ringCount == 0) {
+    ringCount = 1;
+  }
+
+  rings_.reserve(ringCount);
+  for (std::uint32_t i = 0; i < ringCount; ++i) {
+    rings_.push_back(std::make_unique<io_uring_context>(opts.ring));
+  }
+
+  threads_.reserve(ringCount);
+  UNIFEX_TRY {
+    for (std::uint32_t i = 0; i < ringCount; ++i) {
+      threads_.emplace_back([this, i] { run(i); });
+      if (opts.pinThreads && !cpus.empty()) {
+        _thread_affinity::set_thread_affinity(
+            threads_.back(), {cpus[i % cpus.size()]});
+      }
+    }
+  } UNIFEX_CATCH (...) {
+    request_stop_and_join();
+    UNIFEX_RETHROW();
+  }
+}
+
+io_uring_pool::~io_uring_pool() {
+  request_stop_and_join();
+}
+
+io_uring_context& io_uring_pool::select_ring() noexcept {
+  if (currentThreadPool == this) {
+    return *rings_[currentThreadRing];
+  }
+  const auto index = nextRing_.fetch_add(1, std::memory_order_relaxed);
+  return *rings_[index % rings_.size()];
+}
+
+void io_uring_pool::run(std::uint32_t index) {
+  currentThreadPool = this;
+  currentThreadRing = index;
+  rings_[index]->run(stopSource_.get_token());
+}
+
+void io_uring_pool::request_stop_and_join() noexcept {
+  stopSource_.request_stop();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+  threads_.clear();
+}
+
+} // namespace unifex::linuxos
+
+#endif // UNIFEX_NO_LIBURING
@@ -23,7 +23,7 @@ void context::run() {
   while (true) {
     while (head_ == nullptr) {
       if (stop_) return;
-      cv_.wait(lock);
+      wait(lock);
     }
     auto* task = head_;
     head_ = task->next_;
@@ -36,10 +36,27 @@ void context::run() {
   }
 }
 
+void context::wait(std::unique_lock<std::mutex>& lock) {
+  // Register as a waiter and then re-check, so that a task enqueued after
+  // the re-check is guaranteed to wake us.
+  lock.unlock();
+  const auto key = wakeup_.prepare_wait();
+  lock.lock();
+  if (head_ != nullptr || stop_) {
+    wakeup_.cancel_wait();
+    return;
+  }
+  lock.unlock();
+  wakeup_.wait(key, idle_);
+  lock.lock();
+}
+
 void context::stop() {
+  // Notify while holding the lock: once run() observes stop_ the loop
+  // may be destroyed.
   std::unique_lock lock{mutex_};
   stop_ = true;
-  cv_.notify_all();
+  wakeup_.notify_all();
 }
 
 void context::enqueue(task_base* task) {
@@ -51,7 +68,7 @@ void context::enqueue(task_base* task) {
   }
   tail_ = task;
   task->next_ = nullptr;
-  cv_.notify_one();
+  wakeup_.notify_one();
 }
 
 } // _manual_event_loop
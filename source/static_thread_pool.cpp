@@ -15,22 +15,223 @@
  */
 #include <unifex/static_thread_pool.hpp>
 
+#include <unifex/exception.hpp>
+#include <unifex/spin_wait.hpp>
+#include <unifex/detail/thread_affinity.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__linux__)
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include <sched.h>
+#endif
+
 namespace unifex {
 namespace _static_thread_pool {
+  // The pool and thread index of the current thread if it is one of
+  // a static_thread_pool's worker threads.
+  static thread_local context* currentThreadContext = nullptr;
+  static thread_local std::uint32_t currentThreadIndex = 0;
+  static thread_local context::batch* currentBatch = nullptr;
+
+  // Statistics helpers. These compile to nothing unless
+  // UNIFEX_STATIC_THREAD_POOL_STATS is set.
+  template <typename T>
+  static void add_relaxed(std::atomic<T>& counter, T amount) noexcept {
+    // Only the owning thread writes these, no need for a read-modify-write.
+    counter.store(
+        counter.load(std::memory_order_relaxed) + amount,
+        std::memory_order_relaxed);
+  }
+
+  static time_point stats_now() noexcept {
+#if UNIFEX_STATIC_THREAD_POOL_STATS
+    return clock_t::now();
+#else
+    return time_point{};
+#endif
+  }
+
+#if UNIFEX_STATIC_THREAD_POOL_STATS
+  static std::size_t latency_bucket(clock_t::duration latency) noexcept {
+    auto us = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(latency)
+            .count());
+    std::size_t bucket = 0;
+    while (us != 0 && bucket + 1 < latency_bucket_count) {
+      us >>= 1;
+      ++bucket;
+    }
+    return bucket;
+  }
+#endif
+
+  static std::uint32_t
+  partition_thread_count(const options::partition& partition) noexcept {
+    return partition.threadCount != 0
+        ? partition.threadCount
+        : static_cast<std::uint32_t>(partition.cpus.size());
+  }
+
+  static std::uint32_t total_thread_count(const options& opts) noexcept {
+    if (opts.partitions.empty()) {
+      return opts.threadCount != 0 ? opts.threadCount
+                                   : std::thread::hardware_concurrency();
+    }
+    std::uint32_t count = 0;
+    for (auto& partition : opts.partitions) {
+      count += partition_thread_count(partition);
+    }
+    return count;
+  }
+
+#if defined(__linux__)
+  // Parse a kernel CPU list such as "0-3,8,10-11".
+  static std::vector<std::uint32_t> parse_cpu_list(const std::string& list) {
+    // Returns an empty list if 'list' is malformed.
+    std::vector<std::uint32_t> cpus;
+    const char* pos = list.c_str();
+    while (*pos != '\0') {
+      char* end = nullptr;
+      const unsigned long first = std::strtoul(pos, &end, 10);
+      if (end == pos) {
+        return {};
+      }
+      unsigned long last = first;
+      if (*end == '-') {
+        pos = end + 1;
+        last = std::strtoul(pos, &end, 10);
+        if (end == pos || last < first) {
+          return {};
+        }
+      }
+      if (*end == ',') {
+        ++end;
+      } else if (*end != '\0') {
+        return {};
+      }
+      for (auto cpu = first; cpu <= last; ++cpu) {
+        cpus.push_back(static_cast<std::uint32_t>(cpu));
+      }
+      pos = end;
+    }
+    return cpus;
+  }
+#endif
+
+  std::vector<options::partition> options::numa_partitions() {
+    std::vector<partition> partitions;
+#if defined(__linux__)
+    for (std::uint32_t node = 0;; ++node) {
+      std::ifstream file{
+          "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"};
+      std::string list;
+      if (!file || !std::getline(file, list)) {
+        break;
+      }
+      auto cpus = parse_cpu_list(list);
+      if (!cpus.empty()) {
+        partition p;
+        p.cpus = std::move(cpus);
+        partitions.push_back(std::move(p));
+      }
+    }
+#endif
+    return partitions;
+  }
+
   context::context()
     : context(std::thread::hardware_concurrency()) {}
 
+  static options make_options(std::uint32_t threadCount) noexcept {
+    options opts;
+    opts.threadCount = threadCount;
+    return opts;
+  }
+
   context::context(std::uint32_t threadCount)
-    : threadCount_(threadCount)
-    , threadStates_(threadCount)
-    , nextThread_(0) {
-    UNIFEX_ASSERT(threadCount > 0);
+    : context(make_options(threadCount)) {}
+
+  context::context(const options& opts)
+    : threadCount_(std::max(total_thread_count(opts), opts.maxThreadCount))
+    , minThreadCount_(total_thread_count(opts))
+    , elastic_(threadCount_ > minThreadCount_)
+    , growQueueDepth_(opts.growQueueDepth)
+    , growWaitTime_(opts.growWaitTime)
+    , keepAlive_(opts.keepAlive)
+    , workStealing_(opts.workStealing)
+    , runNext_(opts.runNext)
+    , idle_(opts.idle)
+    , threadStates_(threadCount_)
+    , partitions_(std::max<std::size_t>(opts.partitions.size(), 1)) {
+    UNIFEX_ASSERT(threadCount_ > 0);
+    if (elastic_ && !opts.partitions.empty()) {
+      throw_(std::invalid_argument{
+          "static_thread_pool: maxThreadCount cannot be combined with "
+          "partitions"});
+    }
+
+    if (elastic_ && minThreadCount_ == 0) {
+      // Keep one thread around to take over the work of retiring threads.
+      minThreadCount_ = 1;
+    }
+    activeThreadCount_.store(minThreadCount_, std::memory_order_relaxed);
 
-    threads_.reserve(threadCount);
+    allThreads_.end_ = threadCount_;
+    for (auto& state : threadStates_) {
+      state.starvationLimit_ = opts.starvationLimit;
+      state.trackBacklog_ = elastic_;
+    }
+    if (opts.partitions.empty()) {
+      partitions_[0].end_ = threadCount_;
+      for (auto& state : threadStates_) {
+        state.partitionTimerDue_ = &partitions_[0].nextTimerDue_;
+      }
+    } else {
+      std::uint32_t begin = 0;
+      for (std::uint32_t p = 0; p < opts.partitions.size(); ++p) {
+        const auto& partition = opts.partitions[p];
+        const std::uint32_t end = begin + partition_thread_count(partition);
+        if (end == begin) {
+          // No thread would ever run the partition's work.
+          throw_(std::invalid_argument{
+              "static_thread_pool: partition has no threads"});
+        }
+        partitions_[p].begin_ = begin;
+        partitions_[p].end_ = end;
+        for (std::uint32_t i = begin; i < end; ++i) {
+          threadStates_[i].partition_ = p;
+          threadStates_[i].partitionTimerDue_ = &partitions_[p].nextTimerDue_;
+        }
+        for (std::uint32_t cpu : partition.cpus) {
+          if (cpu >= cpuPartitions_.size()) {
+            cpuPartitions_.resize(cpu + 1, any_partition);
+          }
+          cpuPartitions_[cpu] = p;
+        }
+        begin = end;
+      }
+    }
+
+    // Elastic threads are started on demand.
+    threads_.resize(threadCount_);
 
     UNIFEX_TRY {
-      for (std::uint32_t i = 0; i < threadCount; ++i) {
-        threads_.emplace_back([this, i] { run(i); });
+      for (std::uint32_t i = 0; i < minThreadCount_; ++i) {
+        threads_[i] = std::thread([this, i] { run(i); });
+        if (!opts.partitions.empty()) {
+          const auto& cpus = opts.partitions[threadStates_[i].partition_].cpus;
+          if (!cpus.empty()) {
+            _thread_affinity::set_thread_affinity(threads_[i], cpus);
+          }
+        }
+      }
+      if (elastic_) {
+        monitor_ = std::thread([this] { monitor_backlog(); });
       }
     } UNIFEX_CATCH (...) {
       request_stop();
@@ -44,109 +245,1116 @@ namespace _static_thread_pool {
     join();
   }
 
+  stats context::stats() const {
+    _static_thread_pool::stats result;
+#if UNIFEX_STATIC_THREAD_POOL_STATS
+    result.workers.reserve(threadStates_.size());
+    for (auto& state : threadStates_) {
+      auto& counters = state.stats_;
+      auto& worker = result.workers.emplace_back();
+      worker.tasksExecuted =
+          counters.tasksExecuted_.load(std::memory_order_relaxed);
+      worker.tasksStolen = counters.tasksStolen_.load(std::memory_order_relaxed);
+      worker.busyTime = clock_t::duration{
+          counters.busyTime_.load(std::memory_order_relaxed)};
+      worker.idleTime = clock_t::duration{
+          counters.idleTime_.load(std::memory_order_relaxed)};
+      worker.popContention =
+          counters.popContention_.load(std::memory_order_relaxed);
+      worker.pushContention =
+          counters.pushContention_.load(std::memory_order_relaxed);
+      worker.maxQueueDepth =
+          counters.maxQueueDepth_.load(std::memory_order_relaxed);
+      for (std::size_t i = 0; i < latency_bucket_count; ++i) {
+        worker.startLatency[i] =
+            counters.startLatency_[i].load(std::memory_order_relaxed);
+      }
+    }
+#endif
+    return result;
+  }
+
+  void context::execute(std::uint32_t index, task_base* task) noexcept {
+#if UNIFEX_STATIC_THREAD_POOL_STATS
+    auto& counters = threadStates_[index].stats_;
+    const time_point start = clock_t::now();
+    if (task->enqueueTime != time_point{}) {
+      add_relaxed(
+          counters.startLatency_[latency_bucket(start - task->enqueueTime)],
+          std::uint64_t(1));
+    }
+    // The task may be destroyed once it has run.
+    task->execute(task);
+    add_relaxed(counters.busyTime_, (clock_t::now() - start).count());
+    add_relaxed(counters.tasksExecuted_, std::uint64_t(1));
+#else
+    (void)index;
+    task->execute(task);
+#endif
+  }
+
+  void context::record_idle(
+      [[maybe_unused]] thread_state& state,
+      [[maybe_unused]] time_point since) noexcept {
+#if UNIFEX_STATIC_THREAD_POOL_STATS
+    add_relaxed(state.stats_.idleTime_, (clock_t::now() - since).count());
+#endif
+  }
+
+  void context::record_steal([[maybe_unused]] std::uint32_t index) noexcept {
+#if UNIFEX_STATIC_THREAD_POOL_STATS
+    add_relaxed(threadStates_[index].stats_.tasksStolen_, std::uint64_t(1));
+#endif
+  }
+
   void context::request_stop() noexcept {
+    if (elastic_) {
+      {
+        std::lock_guard lk{elasticMutex_};
+        stopping_ = true;
+      }
+      monitorCv_.notify_one();
+    }
     for (auto& state : threadStates_) {
       state.request_stop();
     }
   }
 
   void context::run(std::uint32_t index) noexcept {
+    currentThreadContext = this;
+    currentThreadIndex = index;
+
+    if (workStealing_) {
+      run_work_stealing(index);
+      return;
+    }
+
+    auto& state = threadStates_[index];
+    std::uint32_t runNextStreak = 0;
+
+    while (true) {
+      task_base* task = pop_run_next(state, runNextStreak);
+      if (task == nullptr) {
+        task = try_pop_any(index);
+      }
+      if (task == nullptr) {
+        task = state.runNext_.exchange(nullptr, std::memory_order_acquire);
+      }
+      if (task == nullptr) {
+        task = try_steal_run_next(index);
+      }
+
+      if (task == nullptr) {
+        const time_point deadline = idle_deadline(index);
+        const time_point idleStart = stats_now();
+        if (elastic_) {
+          // Other threads only push to their own queue, so sleep where
+          // maybe_grow() can wake us to take work that is backing up there.
+          state.sleeping_.store(true, std::memory_order_seq_cst);
+          sleepingCount_.fetch_add(1, std::memory_order_seq_cst);
+          task = state.wait(idle_, deadline);
+          sleepingCount_.fetch_sub(1, std::memory_order_relaxed);
+          state.sleeping_.store(false, std::memory_order_relaxed);
+        } else {
+          task = state.pop(idle_, deadline);
+        }
+        record_idle(state, idleStart);
+        if (task == nullptr) {
+          if (take_due_timers(index)) {
+            continue;
+          }
+          // Either request_stop() was called, the thread was woken to look
+          // at the other queues or it has been idle for long enough to
+          // retire, as long as those queues are empty.
+          if (state.stop_requested()) {
+            return;
+          }
+          if (deadline != time_point::max() && clock_t::now() >= deadline) {
+            task = try_pop_any(index);
+            if (task == nullptr && try_retire(index)) {
+              return;
+            }
+          }
+          if (task == nullptr) {
+            continue;
+          }
+        } else if (elastic_) {
+          maybe_grow(state);
+        }
+      }
+
+      execute(index, task);
+    }
+  }
+
+  void context::run_work_stealing(std::uint32_t index) noexcept {
+    auto& state = threadStates_[index];
+
+    // A thread that keeps rescheduling work onto its own deque would
+    // otherwise never look at the shared queues again. Check them first
+    // every so often so that tasks scheduled from outside the pool are
+    // not starved.
+    constexpr std::uint32_t sharedQueueCheckInterval = 61;
+    std::uint32_t tick = 0;
+    std::uint32_t runNextStreak = 0;
+
     while (true) {
       task_base* task = nullptr;
-      for (std::uint32_t i = 0; i < threadCount_; ++i) {
-        auto queueIndex = (index + i) < threadCount_
-            ? (index + i)
-            : (index + i - threadCount_);
-        auto& state = threadStates_[queueIndex];
+      if (++tick == sharedQueueCheckInterval) {
+        tick = 0;
+        task = try_pop_any(index);
+      } else if (state.has_high_priority_work()) {
+        // High priority work is never pushed onto the local deques. Don't
+        // let it wait behind them.
         task = state.try_pop();
-        if (task != nullptr) {
-          break;
-        }
+      }
+      if (task == nullptr) {
+        task = pop_run_next(state, runNextStreak);
+      }
+      if (task == nullptr) {
+        task = state.local_.pop();
+      }
+      if (task == nullptr) {
+        task = try_pop_any(index);
+      }
+      if (task == nullptr) {
+        task = state.runNext_.exchange(nullptr, std::memory_order_acquire);
+      }
+      if (task == nullptr) {
+        task = try_steal(index);
       }
 
       if (task == nullptr) {
-        task = threadStates_[index].pop();
+        // Publish that we are about to sleep before taking a last look at
+        // the other deques. A thread pushing to its deque concurrently will
+        // then either see that we are sleeping and wake us, or we will see
+        // its task here.
+        state.sleeping_.store(true, std::memory_order_seq_cst);
+        sleepingCount_.fetch_add(1, std::memory_order_seq_cst);
+        task = try_steal(index);
+        const time_point deadline = idle_deadline(index);
+        if (task == nullptr) {
+          const time_point idleStart = stats_now();
+          task = state.wait(idle_, deadline);
+          record_idle(state, idleStart);
+        }
+        sleepingCount_.fetch_sub(1, std::memory_order_relaxed);
+        state.sleeping_.store(false, std::memory_order_relaxed);
+
         if (task == nullptr) {
-          // request_stop() was called.
-          return;
+          if (take_due_timers(index)) {
+            continue;
+          }
+          // Either woken to go looking for work to steal or request_stop()
+          // was called. Only exit once there is nothing left to run.
+          if (state.stop_requested()) {
+            task = try_pop_any(index);
+            if (task == nullptr) {
+              task = try_steal(index);
+            }
+            if (task == nullptr) {
+              return;
+            }
+          } else if (
+              deadline != time_point::max() && clock_t::now() >= deadline) {
+            // Take one more look at the shared queues before retiring.
+            task = try_pop_any(index);
+            if (task == nullptr) {
+              if (try_retire(index)) {
+                return;
+              }
+              continue;
+            }
+          } else {
+            continue;
+          }
+        } else if (elastic_) {
+          maybe_grow(state);
+        }
+      }
+
+      execute(index, task);
+    }
+  }
+
+  template <typename Func>
+  bool context::visit_threads(
+      std::uint32_t index, bool includeSelf, Func func) noexcept {
+    const std::uint32_t partitionCount = partition_count();
+    const std::uint32_t ownPartition = threadStates_[index].partition_;
+
+    // Own partition first, starting with 'index'.
+    {
+      const auto& threads = partitions_[ownPartition];
+      const std::uint32_t size = threads.size();
+      const std::uint32_t offset = index - threads.begin_;
+      for (std::uint32_t i = includeSelf ? 0 : 1; i < size; ++i) {
+        const auto threadOffset =
+            (offset + i) < size ? (offset + i) : (offset + i - size);
+        if (func(threadStates_[threads.begin_ + threadOffset])) {
+          return true;
+        }
+      }
+    }
+
+    // Then the other partitions.
+    for (std::uint32_t p = 1; p < partitionCount; ++p) {
+      const auto partition = (ownPartition + p) < partitionCount
+          ? (ownPartition + p)
+          : (ownPartition + p - partitionCount);
+      const auto& threads = partitions_[partition];
+      for (std::uint32_t i = threads.begin_; i < threads.end_; ++i) {
+        if (func(threadStates_[i])) {
+          return true;
         }
       }
+    }
+
+    return false;
+  }
+
+  task_base* context::try_pop_any(std::uint32_t index) noexcept {
+    task_base* task = nullptr;
+    visit_threads(index, true, [&](thread_state& state) noexcept {
+      task = state.try_pop();
+      if (task != nullptr && elastic_) {
+        maybe_grow(state);
+      }
+      if (task != nullptr && &state != &threadStates_[index]) {
+        record_steal(index);
+      }
+      return task != nullptr;
+    });
+    return task;
+  }
+
+  task_base* context::try_steal(std::uint32_t index) noexcept {
+    task_base* task = nullptr;
+    visit_threads(index, false, [&](thread_state& state) noexcept {
+      task = state.local_.steal();
+      return task != nullptr;
+    });
+    if (task == nullptr) {
+      return try_steal_run_next(index);
+    }
+    record_steal(index);
+    return task;
+  }
+
+  task_base* context::try_steal_run_next(std::uint32_t index) noexcept {
+    if (!runNext_) {
+      return nullptr;
+    }
+
+    // The owner is most likely about to run the task itself, which is the
+    // point of the slot. Give it a moment before taking the task away.
+    constexpr std::uint32_t ownerGracePeriod = 64;
 
-      task->execute(task);
+    task_base* task = nullptr;
+    visit_threads(index, false, [&](thread_state& state) noexcept {
+      if (state.runNext_.load(std::memory_order_relaxed) == nullptr) {
+        return false;
+      }
+      for (std::uint32_t i = 0; i < ownerGracePeriod &&
+           state.runNext_.load(std::memory_order_relaxed) != nullptr;
+           ++i) {
+        spin_loop_pause();
+      }
+      task = state.runNext_.exchange(nullptr, std::memory_order_acquire);
+      return task != nullptr;
+    });
+    if (task != nullptr) {
+      record_steal(index);
     }
+    return task;
+  }
+
+  task_base* context::pop_run_next(
+      thread_state& state, std::uint32_t& streak) noexcept {
+    // Bound the number of tasks run from the slot in a row so that a pair
+    // of tasks that keep scheduling each other can't starve the queues.
+    constexpr std::uint32_t runNextLimit = 3;
+
+    if (streak < runNextLimit &&
+        state.runNext_.load(std::memory_order_relaxed) != nullptr) {
+      task_base* task =
+          state.runNext_.exchange(nullptr, std::memory_order_acquire);
+      if (task != nullptr) {
+        ++streak;
+        return task;
+      }
+    }
+    streak = 0;
+    return nullptr;
+  }
+
+  bool context::wake_one_sleeper(std::uint32_t index) noexcept {
+    return visit_threads(index, false, [](thread_state& state) noexcept {
+      if (state.sleeping_.load(std::memory_order_relaxed) &&
+          state.sleeping_.exchange(false, std::memory_order_acq_rel)) {
+        state.notify();
+        return true;
+      }
+      return false;
+    });
   }
 
   void context::join() noexcept {
+    if (monitor_.joinable()) {
+      monitor_.join();
+    }
     for (auto& t : threads_) {
-      t.join();
+      if (t.joinable()) {
+        t.join();
+      }
     }
     threads_.clear();
   }
 
-  void context::enqueue(task_base* task) noexcept {
-    const std::uint32_t threadCount = static_cast<std::uint32_t>(threads_.size());
+  time_point context::idle_deadline(std::uint32_t index) const noexcept {
+    if (!elastic_ || index < minThreadCount_) {
+      return time_point::max();
+    }
+    return clock_t::now() + keepAlive_;
+  }
+
+  void context::maybe_grow(const thread_state& state) noexcept {
+    if (!state.backlogged(growQueueDepth_, growWaitTime_)) {
+      return;
+    }
+    // A sleeping thread in work-stealing mode goes looking for work as soon
+    // as it is woken. Otherwise it was asleep on its own, empty queue and is
+    // only woken to take the work once no more threads can be started.
+    const auto index = static_cast<std::uint32_t>(&state - &threadStates_[0]);
+    if ((workStealing_ && wake_one_sleeper(index)) || grow()) {
+      return;
+    }
+    wake_one_sleeper(index);
+  }
+
+  void context::maybe_grow(bool backlogged) noexcept {
+    if (backlogged) {
+      grow();
+    }
+  }
+
+  bool context::grow() noexcept {
+    if (activeThreadCount_.load(std::memory_order_relaxed) == threadCount_) {
+      return false;
+    }
+    std::lock_guard lk{elasticMutex_};
+    const std::uint32_t index =
+        activeThreadCount_.load(std::memory_order_relaxed);
+    if (stopping_ || index == threadCount_) {
+      return false;
+    }
+
+    auto& thread = threads_[index];
+    if (thread.joinable()) {
+      // The previous thread in this slot has retired and is on its way out.
+      thread.join();
+    }
+    threadStates_[index].reactivate();
+    UNIFEX_TRY {
+      thread = std::thread([this, index] { run(index); });
+    } UNIFEX_CATCH (...) {
+      // Carry on with the threads we have.
+      return false;
+    }
+    activeThreadCount_.store(index + 1, std::memory_order_release);
+    return true;
+  }
+
+  void context::monitor_backlog() noexcept {
+    std::unique_lock lk{elasticMutex_};
+    while (!stopping_) {
+      // Publish that we may go to sleep before looking at the queues. A
+      // thread pushing concurrently will then either see the flag and wake
+      // us, or we will see its task here.
+      monitorIdle_.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      const std::uint32_t activeCount =
+          activeThreadCount_.load(std::memory_order_relaxed);
+      lk.unlock();
+
+      // A queue whose thread is busy running a long task only backs up
+      // through growWaitTime_ with nothing else happening to notice it.
+      bool queued = false;
+      for (std::uint32_t i = 0; i < activeCount; ++i) {
+        if (threadStates_[i].has_queued_work()) {
+          queued = true;
+          maybe_grow(threadStates_[i]);
+        }
+      }
+
+      lk.lock();
+      if (queued) {
+        monitorIdle_.store(false, std::memory_order_relaxed);
+        monitorCv_.wait_for(lk, growWaitTime_);
+      } else {
+        monitorCv_.wait(lk, [this] {
+          return stopping_ || !monitorIdle_.load(std::memory_order_relaxed);
+        });
+      }
+    }
+  }
+
+  void context::wake_monitor() noexcept {
+    // Pairs with the fence in monitor_backlog().
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (monitorIdle_.load(std::memory_order_relaxed) &&
+        monitorIdle_.exchange(false, std::memory_order_relaxed)) {
+      // Wait for the monitor to be waiting, so that it can't miss this.
+      { std::lock_guard lk{elasticMutex_}; }
+      monitorCv_.notify_one();
+    }
+  }
+
+  bool context::try_retire(std::uint32_t index) noexcept {
+    {
+      std::lock_guard lk{elasticMutex_};
+      // Only the most recently started thread retires so that the running
+      // threads stay contiguous.
+      if (stopping_ || index < minThreadCount_ ||
+          activeThreadCount_.load(std::memory_order_relaxed) != index + 1) {
+        return false;
+      }
+      activeThreadCount_.store(index, std::memory_order_release);
+    }
+
+    // Only this thread pushes to its deque and run-next slot, and it found
+    // both empty before going idle. Anything that was pushed to its queue
+    // since goes to the first thread, which never retires.
+    auto& state = threadStates_[index];
+    UNIFEX_ASSERT(state.local_.empty());
+    UNIFEX_ASSERT(state.runNext_.load(std::memory_order_relaxed) == nullptr);
+    state.retire(threadStates_[0]);
+    return true;
+  }
+
+  void context::enqueue(
+      task_base* task, std::uint32_t partition, priority prio) noexcept {
+#if UNIFEX_STATIC_THREAD_POOL_STATS
+    task->enqueueTime = clock_t::now();
+#endif
+    if (currentBatch != nullptr && &currentBatch->pool_ == this &&
+        currentBatch->partition_ == partition &&
+        currentBatch->priority_ == prio) {
+      currentBatch->tasks_.push_back(task);
+      ++currentBatch->count_;
+      return;
+    }
+
+    const bool onPoolThread = currentThreadContext == this;
+    if (partition == any_partition) {
+      partition = onPoolThread ? threadStates_[currentThreadIndex].partition_
+                               : submitting_partition();
+    }
+
+    if (runNext_ && onPoolThread && prio == priority::normal &&
+        threadStates_[currentThreadIndex].partition_ == partition) {
+      // Run this task next on the current thread and schedule whichever
+      // task it displaced as usual.
+      task = threadStates_[currentThreadIndex].runNext_.exchange(
+          task, std::memory_order_acq_rel);
+      if (task == nullptr) {
+        return;
+      }
+    }
+
+    if (workStealing_ && onPoolThread && prio == priority::normal &&
+        threadStates_[currentThreadIndex].partition_ == partition) {
+      // Fast path: scheduling from one of our own threads. Push onto that
+      // thread's deque without taking any locks.
+      const std::uint32_t index = currentThreadIndex;
+      auto& local = threadStates_[index].local_;
+      if (local.try_push(task)) {
+        // Pairs with the fence implied by the sleeping thread's seq_cst
+        // increment of sleepingCount_ before it re-checks the deques.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepingCount_.load(std::memory_order_relaxed) > 0) {
+          wake_one_sleeper(index);
+        } else if (elastic_) {
+          maybe_grow(local.size() >= growQueueDepth_);
+        }
+        return;
+      }
+      // Deque is full. Fall back to the shared queues.
+    }
+
+    auto& threads = partitions_[partition];
+    const std::uint32_t threadCount = thread_count_for(threads);
     const std::uint32_t startIndex =
-        nextThread_.fetch_add(1, std::memory_order_relaxed) % threadCount;
+        threads.nextThread_.fetch_add(1, std::memory_order_relaxed) % threadCount;
 
     // First try to enqueue to one of the threads without blocking.
+    thread_state* target = nullptr;
     for (std::uint32_t i = 0; i < threadCount; ++i) {
       const auto index = (startIndex + i) < threadCount
           ? (startIndex + i)
           : (startIndex + i - threadCount);
-      if (threadStates_[index].try_push(task)) {
+      if (threadStates_[threads.begin_ + index].try_push(task, prio)) {
+        target = &threadStates_[threads.begin_ + index];
+        break;
+      }
+    }
+
+    if (target == nullptr) {
+      // Otherwise, do a blocking enqueue on the selected thread, or on the
+      // first thread if that one has just retired.
+      target = &threadStates_[threads.begin_ + startIndex];
+      if (!target->push(task, prio)) {
+        target = &threadStates_[0];
+        target->push(task, prio);
+      }
+    }
+
+    if (elastic_) {
+      maybe_grow(*target);
+      wake_monitor();
+    }
+  }
+
+  void context::enqueue(
+      task_queue tasks,
+      std::uint32_t count,
+      std::uint32_t partition,
+      priority prio) noexcept {
+    if (count == 0) {
+      return;
+    }
+
+    const bool onPoolThread = currentThreadContext == this;
+    if (partition == any_partition) {
+      partition = onPoolThread ? threadStates_[currentThreadIndex].partition_
+                               : submitting_partition();
+    }
+
+    if (workStealing_ && onPoolThread && prio == priority::normal &&
+        threadStates_[currentThreadIndex].partition_ == partition) {
+      // Push as many tasks as fit onto this thread's deque and then wake
+      // up to one sleeper per task pushed.
+      const std::uint32_t index = currentThreadIndex;
+      auto& local = threadStates_[index].local_;
+      std::uint32_t pushed = 0;
+      while (!tasks.empty()) {
+        task_base* task = tasks.pop_front();
+        if (!local.try_push(task)) {
+          tasks.push_front(task);
+          break;
+        }
+        ++pushed;
+      }
+      count -= pushed;
+
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      std::uint32_t sleepers = sleepingCount_.load(std::memory_order_relaxed);
+      for (std::uint32_t i = 0; i < std::min(pushed, sleepers); ++i) {
+        if (!wake_one_sleeper(index)) {
+          break;
+        }
+      }
+
+      if (count == 0) {
         return;
       }
+      // Deque is full. Fall back to the shared queues for the rest.
     }
 
-    // Otherwise, do a blocking enqueue on the selected thread.
-    threadStates_[startIndex].push(task);
+    // Split the tasks into one contiguous run per target thread, with run
+    // lengths that differ by at most one.
+    auto& threads = partitions_[partition];
+    const std::uint32_t threadCount = thread_count_for(threads);
+    const std::uint32_t targetCount = std::min(count, threadCount);
+    const std::uint32_t startIndex =
+        threads.nextThread_.fetch_add(targetCount, std::memory_order_relaxed);
+    const std::uint32_t base = count / targetCount;
+    const std::uint32_t extra = count % targetCount;
+    for (std::uint32_t i = 0; i < targetCount; ++i) {
+      task_queue run;
+      const std::uint32_t size = base + (i < extra ? 1 : 0);
+      for (std::uint32_t j = 0; j < size; ++j) {
+        run.push_back(tasks.pop_front());
+      }
+      auto* target =
+          &threadStates_[threads.begin_ + (startIndex + i) % threadCount];
+      if (!target->push(run, size, prio)) {
+        target = &threadStates_[0];
+        target->push(run, size, prio);
+      }
+      if (elastic_) {
+        maybe_grow(*target);
+      }
+    }
+    UNIFEX_ASSERT(tasks.empty());
+    if (elastic_) {
+      wake_monitor();
+    }
+  }
+
+  context::batch::batch(const scheduler& s) noexcept
+    : pool_(s.pool_)
+    , partition_(s.partition_)
+    , priority_(s.priority_)
+    , previous_(currentBatch) {
+    currentBatch = this;
+  }
+
+  context::batch::~batch() {
+    UNIFEX_ASSERT(currentBatch == this);
+    currentBatch = previous_;
+    submit();
+  }
+
+  void context::batch::submit() noexcept {
+    pool_.enqueue(
+        std::move(tasks_), std::exchange(count_, 0), partition_, priority_);
+  }
+
+  std::uint32_t context::submitting_partition() noexcept {
+    const std::uint32_t partitionCount = partition_count();
+    if (partitionCount == 1) {
+      return 0;
+    }
+#if defined(__linux__)
+    if (!cpuPartitions_.empty()) {
+      const int cpu = ::sched_getcpu();
+      if (cpu >= 0 && static_cast<std::size_t>(cpu) < cpuPartitions_.size() &&
+          cpuPartitions_[cpu] != any_partition) {
+        return cpuPartitions_[cpu];
+      }
+    }
+#endif
+    return nextPartition_.fetch_add(1, std::memory_order_relaxed) %
+        partitionCount;
+  }
+
+  std::uint32_t context::timer_shard_for(std::uint32_t partition) noexcept {
+    // Keep timers scheduled from a worker on that worker's own queue.
+    // Threads that may retire don't hold timers.
+    if (currentThreadContext == this && currentThreadIndex < minThreadCount_ &&
+        (partition == any_partition ||
+         threadStates_[currentThreadIndex].partition_ == partition)) {
+      return currentThreadIndex;
+    }
+    if (partition == any_partition) {
+      partition = submitting_partition();
+    }
+    auto& threads = partitions_[partition];
+    return threads.begin_ +
+        threads.nextThread_.fetch_add(1, std::memory_order_relaxed) %
+        (elastic_ ? minThreadCount_ : threads.size());
+  }
+
+  void context::add_timer(timer_task_base* task) noexcept {
+    // Once queued the timer may run and be destroyed at any moment.
+    const std::uint32_t shard = task->timerShard_;
+    const clock_t::rep dueTime = task->dueTime_.time_since_epoch().count();
+    threadStates_[shard].add_timer(task);
+
+    auto& threads = partitions_[threadStates_[shard].partition_];
+    {
+      std::lock_guard lk{threads.timerMut_};
+      if (dueTime >= threads.nextTimerDue_.load(std::memory_order_relaxed)) {
+        return;
+      }
+      threads.nextTimerDue_.store(dueTime, std::memory_order_seq_cst);
+    }
+    // The other threads may be asleep with a later wake-up time. The shard
+    // itself was woken by thread_state::add_timer() if it needs to be.
+    const std::uint32_t end = threads.begin_ + thread_count_for(threads);
+    for (std::uint32_t i = threads.begin_; i < end; ++i) {
+      if (i != shard) {
+        threadStates_[i].wake();
+      }
+    }
+  }
+
+  bool context::take_due_timers(std::uint32_t index) noexcept {
+    auto& state = threadStates_[index];
+    auto& threads = partitions_[state.partition_];
+    if (threads.nextTimerDue_.load(std::memory_order_seq_cst) >
+        clock_t::now().time_since_epoch().count()) {
+      return false;
+    }
+
+    // Holding timerMut_ while looking at every shard means that a timer
+    // added to a shard after we looked lowers nextTimerDue_ afterwards.
+    std::lock_guard lk{threads.timerMut_};
+    bool taken = false;
+    time_point next = time_point::max();
+    for (std::uint32_t i = threads.begin_; i < threads.end_; ++i) {
+      time_point shardNext;
+      if (threadStates_[i].take_due_timers(state, shardNext)) {
+        taken = true;
+      }
+      next = std::min(next, shardNext);
+    }
+    threads.nextTimerDue_.store(
+        next.time_since_epoch().count(), std::memory_order_seq_cst);
+    return taken;
+  }
+
+  void context::enqueue_on(
+      task_base* task, std::uint32_t index, priority prio) noexcept {
+#if UNIFEX_STATIC_THREAD_POOL_STATS
+    task->enqueueTime = clock_t::now();
+#endif
+    auto& state = threadStates_[index];
+    if (!state.try_push(task, prio) && !state.push(task, prio)) {
+      // The thread has retired.
+      threadStates_[0].push(task, prio);
+    }
   }
 
   task_base* context::thread_state::try_pop() {
     std::unique_lock lk{mut_, std::try_to_lock};
-    if (!lk || queue_.empty()) {
+    if (!lk) {
+#if UNIFEX_STATIC_THREAD_POOL_STATS
+      stats_.popContention_.fetch_add(1, std::memory_order_relaxed);
+#endif
       return nullptr;
     }
-    return queue_.pop_front();
+    queue_due_timers_();
+    return try_pop_queued_();
   }
 
-  task_base* context::thread_state::pop() {
+  task_base* context::thread_state::pop(
+      const idle_strategy& idle, time_point deadline) {
     std::unique_lock lk{mut_};
-    while (queue_.empty()) {
-      if (stopRequested_) {
+    while (true) {
+      queue_due_timers_();
+      if (task_base* task = try_pop_queued_()) {
+        return task;
+      }
+      if (stopRequested_ || partition_timer_due_() ||
+          (deadline != time_point::max() && clock_t::now() >= deadline)) {
         return nullptr;
       }
-      cv_.wait(lk);
+      wait_(lk, idle, deadline);
     }
-    return queue_.pop_front();
   }
 
-  bool context::thread_state::try_push(task_base* task) {
+  task_base* context::thread_state::try_pop_queued_() {
+    std::size_t lane = 0;
+    while (lane < priority_count && queues_[lane].empty()) {
+      ++lane;
+    }
+    if (lane == priority_count) {
+      return nullptr;
+    }
+
+    // Every lane below the one we are about to run has been passed over
+    // once more. Give the highest such lane that has hit the limit a turn
+    // instead.
+    for (std::size_t lower = lane + 1; lower < priority_count; ++lower) {
+      if (!queues_[lower].empty() && ++skipped_[lower] > starvationLimit_) {
+        skipped_[lower] = 0;
+        queuedCount_.store(
+            queuedCount_.load(std::memory_order_relaxed) - 1,
+            std::memory_order_relaxed);
+        return queues_[lower].pop_front();
+      }
+    }
+
+    skipped_[lane] = 0;
+    if (lane == static_cast<std::size_t>(priority::high)) {
+      highPriorityCount_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    queuedCount_.store(
+        queuedCount_.load(std::memory_order_relaxed) - 1,
+        std::memory_order_relaxed);
+    return queues_[lane].pop_front();
+  }
+
+  void context::thread_state::push_locked_(
+      task_base* task, priority prio) noexcept {
+    if (prio == priority::high) {
+      highPriorityCount_.fetch_add(1, std::memory_order_relaxed);
+    }
+    add_queued_(1);
+    queues_[static_cast<std::size_t>(prio)].push_back(task);
+  }
+
+  void context::thread_state::add_queued_(std::uint32_t count) noexcept {
+    const std::uint32_t queued = queuedCount_.load(std::memory_order_relaxed);
+    if (queued == 0 && trackBacklog_) {
+      backlogSince_.store(
+          clock_t::now().time_since_epoch().count(), std::memory_order_relaxed);
+    }
+    queuedCount_.store(queued + count, std::memory_order_relaxed);
+#if UNIFEX_STATIC_THREAD_POOL_STATS
+    if (queued + count > stats_.maxQueueDepth_.load(std::memory_order_relaxed)) {
+      stats_.maxQueueDepth_.store(queued + count, std::memory_order_relaxed);
+    }
+#endif
+  }
+
+  bool context::thread_state::backlogged(
+      std::uint32_t depth, clock_t::duration waitTime) const noexcept {
+    const std::uint32_t queued = queuedCount_.load(std::memory_order_relaxed);
+    if (queued == 0) {
+      return false;
+    }
+    if (queued >= depth) {
+      return true;
+    }
+    const time_point since{
+        clock_t::duration{backlogSince_.load(std::memory_order_relaxed)}};
+    return clock_t::now() - since >= waitTime;
+  }
+
+  void context::thread_state::queue_due_timers_() {
+    task_queue due[priority_count];
+    std::uint32_t counts[priority_count] = {};
+    if (pop_due_timers_(due, counts)) {
+      prepend_timers_(due, counts);
+    }
+  }
+
+  bool context::thread_state::pop_due_timers_(
+      task_queue (&due)[priority_count],
+      std::uint32_t (&counts)[priority_count]) {
+    if (timers_.empty()) {
+      return false;
+    }
+    const time_point now = clock_t::now();
+    if (timers_.top()->dueTime_ > now) {
+      return false;
+    }
+
+    while (!timers_.empty() && timers_.top()->dueTime_ <= now) {
+      timer_task_base* timer = timers_.pop();
+      timer->timerQueued_ = false;
+      const auto lane = static_cast<std::size_t>(timer->priority_);
+      due[lane].push_back(timer);
+      ++counts[lane];
+    }
+    return true;
+  }
+
+  void context::thread_state::prepend_timers_(
+      task_queue (&due)[priority_count],
+      const std::uint32_t (&counts)[priority_count]) noexcept {
+    // Due timers are already late, run them ahead of the other work in
+    // their lane.
+    for (std::size_t lane = 0; lane < priority_count; ++lane) {
+      if (counts[lane] == 0) {
+        continue;
+      }
+      if (lane == static_cast<std::size_t>(priority::high)) {
+        highPriorityCount_.fetch_add(counts[lane], std::memory_order_relaxed);
+      }
+      add_queued_(counts[lane]);
+      queues_[lane].prepend(std::move(due[lane]));
+    }
+  }
+
+  void context::thread_state::wait_(
+      std::unique_lock<std::mutex>& lk,
+      const idle_strategy& idle,
+      time_point deadline) {
+    // Register as a waiter and then re-check, so that anything pushed
+    // after the re-check is guaranteed to wake us.
+    lk.unlock();
+    const auto key = wakeup_.prepare_wait();
+    lk.lock();
+
+    if (!queues_empty_() || stopRequested_ || notified_) {
+      wakeup_.cancel_wait();
+      return;
+    }
+    time_point dueTime = timers_.empty()
+        ? deadline
+        : std::min(deadline, timers_.top()->dueTime_);
+    if (partitionTimerDue_ != nullptr) {
+      dueTime = std::min(
+          dueTime,
+          time_point{clock_t::duration{
+              partitionTimerDue_->load(std::memory_order_seq_cst)}});
+    }
+
+    lk.unlock();
+    wakeup_.wait_until(key, idle, dueTime);
+    lk.lock();
+  }
+
+  bool context::thread_state::take_due_timers(
+      thread_state& to, time_point& next) {
+    task_queue due[priority_count];
+    std::uint32_t counts[priority_count] = {};
+    bool taken;
+    {
+      std::lock_guard lk{mut_};
+      taken = pop_due_timers_(due, counts);
+      next = timers_.empty() ? time_point::max() : timers_.top()->dueTime_;
+    }
+    if (taken) {
+      std::lock_guard lk{to.mut_};
+      UNIFEX_ASSERT(!to.retired_);
+      to.prepend_timers_(due, counts);
+    }
+    return taken;
+  }
+
+  void context::thread_state::wake() {
+    wakeup_.notify_one();
+  }
+
+  void context::thread_state::add_timer(timer_task_base* task) {
+    std::unique_lock lk{mut_};
+    timers_.insert(task);
+    task->timerQueued_ = true;
+    const bool isEarliest = timers_.top() == task;
+    lk.unlock();
+    if (isEarliest) {
+      // The earliest due time has changed, wake the thread so that it
+      // waits for the new one.
+      wakeup_.notify_one();
+    }
+  }
+
+  void context::thread_state::cancel_timer(timer_task_base* task) {
+    std::unique_lock lk{mut_};
+    if (task->timerQueued_) {
+      timers_.remove(task);
+      task->timerQueued_ = false;
+      // Completing a cancelled timer is cheap, run it ahead of everything.
+      highPriorityCount_.fetch_add(1, std::memory_order_relaxed);
+      add_queued_(1);
+      queues_[static_cast<std::size_t>(priority::high)].push_front(task);
+      lk.unlock();
+      wakeup_.notify_one();
+    } else {
+      // Either the timer has already fired, in which case this is a no-op,
+      // or start() has not added it to the queue yet, in which case it
+      // will be added as already due.
+      task->dueTime_ = time_point::min();
+    }
+  }
+
+  bool context::thread_state::try_push(task_base* task, priority prio) {
     std::unique_lock lk{mut_, std::try_to_lock};
     if (!lk) {
+#if UNIFEX_STATIC_THREAD_POOL_STATS
+      stats_.pushContention_.fetch_add(1, std::memory_order_relaxed);
+#endif
+      return false;
+    }
+    if (retired_) {
       return false;
     }
-    const bool wasEmpty = queue_.empty();
-    queue_.push_back(task);
+    const bool wasEmpty = queues_empty_();
+    push_locked_(task, prio);
+    lk.unlock();
     if (wasEmpty) {
-      cv_.notify_one();
+      wakeup_.notify_one();
     }
     return true;
   }
 
-  void context::thread_state::push(task_base* task) {
-    std::lock_guard lk{mut_};
-    const bool wasEmpty = queue_.empty();
-    queue_.push_back(task);
+  bool context::thread_state::push(task_base* task, priority prio) {
+    std::unique_lock lk{mut_};
+    if (retired_) {
+      return false;
+    }
+    const bool wasEmpty = queues_empty_();
+    push_locked_(task, prio);
+    lk.unlock();
+    if (wasEmpty) {
+      wakeup_.notify_one();
+    }
+    return true;
+  }
+
+  bool context::thread_state::push(
+      task_queue& tasks, std::uint32_t count, priority prio) {
+    std::unique_lock lk{mut_};
+    if (retired_) {
+      return false;
+    }
+    const bool wasEmpty = queues_empty_();
+    if (prio == priority::high) {
+      highPriorityCount_.fetch_add(count, std::memory_order_relaxed);
+    }
+    add_queued_(count);
+    queues_[static_cast<std::size_t>(prio)].append(std::move(tasks));
+    lk.unlock();
     if (wasEmpty) {
-      cv_.notify_one();
+      wakeup_.notify_one();
+    }
+    return true;
+  }
+
+  void context::thread_state::retire(thread_state& heir) {
+    task_queue tasks[priority_count];
+    std::uint32_t counts[priority_count] = {};
+    {
+      std::lock_guard lk{mut_};
+      retired_ = true;
+      for (std::size_t lane = 0; lane < priority_count; ++lane) {
+        while (!queues_[lane].empty()) {
+          tasks[lane].push_back(queues_[lane].pop_front());
+          ++counts[lane];
+        }
+        skipped_[lane] = 0;
+      }
+      highPriorityCount_.store(0, std::memory_order_relaxed);
+      queuedCount_.store(0, std::memory_order_relaxed);
+      UNIFEX_ASSERT(timers_.empty());
+    }
+    for (std::size_t lane = 0; lane < priority_count; ++lane) {
+      if (counts[lane] != 0) {
+        heir.push(tasks[lane], counts[lane], static_cast<priority>(lane));
+      }
     }
   }
 
+  void context::thread_state::reactivate() {
+    std::lock_guard lk{mut_};
+    retired_ = false;
+    notified_ = false;
+  }
+
   void context::thread_state::request_stop() {
+    {
+      std::lock_guard lk{mut_};
+      stopRequested_ = true;
+    }
+    wakeup_.notify_one();
+  }
+
+  bool context::thread_state::stop_requested() {
     std::lock_guard lk{mut_};
-    stopRequested_ = true;
-    cv_.notify_one();
+    return stopRequested_;
+  }
+
+  task_base* context::thread_state::wait(
+      const idle_strategy& idle, time_point deadline) {
+    std::unique_lock lk{mut_};
+    while (true) {
+      queue_due_timers_();
+      task_base* task = try_pop_queued_();
+      if (task != nullptr || stopRequested_ || notified_ ||
+          partition_timer_due_() ||
+          (deadline != time_point::max() && clock_t::now() >= deadline)) {
+        notified_ = false;
+        return task;
+      }
+      wait_(lk, idle, deadline);
+    }
+  }
+
+  void context::thread_state::notify() {
+    {
+      std::lock_guard lk{mut_};
+      notified_ = true;
+    }
+    wakeup_.notify_one();
+  }
+
+  void timer_cancel_callback::operator()() noexcept {
+    task_->pool_.threadStates_[task_->timerShard_].cancel_timer(task_);
   }
 
 } // namespace _static_thread_pool
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <unifex/detail/thread_affinity.hpp>
+
+#include <unifex/exception.hpp>
+
+#include <system_error>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace unifex {
+namespace _thread_affinity {
+
+std::vector<std::uint32_t> allowed_cpus() {
+  std::vector<std::uint32_t> cpus;
+#if defined(__linux__)
+  cpu_set_t cpuSet;
+  CPU_ZERO(&cpuSet);
+  if (::sched_getaffinity(0, sizeof(cpuSet), &cpuSet) == 0) {
+    for (std::uint32_t cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &cpuSet)) {
+        cpus.push_back(cpu);
+      }
+    }
+  }
+#endif
+  return cpus;
+}
+
+void set_thread_affinity(
+    [[maybe_unused]] std::thread& thread,
+    [[maybe_unused]] const std::vector<std::uint32_t>& cpus) {
+#if defined(__linux__)
+  cpu_set_t cpuSet;
+  CPU_ZERO(&cpuSet);
+  for (std::uint32_t cpu : cpus) {
+    if (cpu >= CPU_SETSIZE) {
+      throw_(std::system_error{EINVAL, std::system_category()});
+    }
+    CPU_SET(cpu, &cpuSet);
+  }
+  int result =
+      ::pthread_setaffinity_np(thread.native_handle(), sizeof(cpuSet), &cpuSet);
+  if (result != 0) {
+    throw_(std::system_error{result, std::system_category()});
+  }
+#endif
+}
+
+} // namespace _thread_affinity
+} // namespace unifex
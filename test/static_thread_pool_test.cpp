@@ -14,15 +14,31 @@
  * limitations under the License.
  */
 
+#include <unifex/async_scope.hpp>
+#include <unifex/bulk_join.hpp>
+#include <unifex/bulk_schedule.hpp>
+#include <unifex/bulk_transform.hpp>
 #include <unifex/just.hpp>
+#include <unifex/let_value_with_stop_source.hpp>
 #include <unifex/on.hpp>
+#include <unifex/repeat_effect_until.hpp>
 #include <unifex/scheduler_concepts.hpp>
 #include <unifex/static_thread_pool.hpp>
+#include <unifex/stop_when.hpp>
 #include <unifex/sync_wait.hpp>
 #include <unifex/then.hpp>
 #include <unifex/when_all.hpp>
 
 #include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
 
 #include <gtest/gtest.h>
 
@@ -62,3 +78,539 @@ TEST(StaticThreadPool, Smoke) {
 
   EXPECT_EQ(x, 3);
 }
+
+TEST(StaticThreadPool, WorkStealing) {
+  static_thread_pool_options opts;
+  opts.threadCount = 4;
+  opts.workStealing = true;
+  static_thread_pool tpContext{opts};
+  auto tp = tpContext.get_scheduler();
+  std::atomic<int> x = 0;
+
+  // Each chain reschedules itself from a pool thread, exercising the
+  // thread-local deque push/pop and stealing paths.
+  auto chain = [&] {
+    return repeat_effect_until(
+        run_on(tp, [&] { ++x; }),
+        [n = 0]() mutable { return ++n == 1000; });
+  };
+
+  sync_wait(when_all(chain(), chain(), chain(), chain(), chain(), chain()));
+
+  EXPECT_EQ(x, 6000);
+}
+
+TEST(StaticThreadPool, BulkSchedule) {
+  static_thread_pool tpContext{4};
+  auto tp = tpContext.get_scheduler();
+
+  const std::size_t count = 10000;
+  std::vector<int> output(count, 0);
+
+  sync_wait(bulk_join(bulk_transform(
+      bulk_schedule(tp, count),
+      [&](std::size_t index) noexcept { output[index] += static_cast<int>(index); },
+      par_unseq)));
+
+  for (std::size_t i = 0; i < count; ++i) {
+    EXPECT_EQ(static_cast<int>(i), output[i]);
+  }
+}
+
+TEST(StaticThreadPool, BulkScheduleEmpty) {
+  static_thread_pool tpContext{4};
+  auto tp = tpContext.get_scheduler();
+
+  std::atomic<int> calls = 0;
+  sync_wait(bulk_join(bulk_transform(
+      bulk_schedule(tp, std::size_t(0)),
+      [&](std::size_t) noexcept { ++calls; },
+      par)));
+
+  EXPECT_EQ(0, calls);
+}
+
+TEST(StaticThreadPool, BulkScheduleSequenced) {
+  static_thread_pool tpContext{4};
+  auto tp = tpContext.get_scheduler();
+
+  const std::size_t count = 1000;
+  std::vector<std::size_t> order;
+
+  sync_wait(bulk_join(bulk_transform(
+      bulk_schedule(tp, count),
+      [&](std::size_t index) noexcept { order.push_back(index); },
+      seq)));
+
+  ASSERT_EQ(count, order.size());
+  for (std::size_t i = 0; i < count; ++i) {
+    EXPECT_EQ(i, order[i]);
+  }
+}
+
+TEST(StaticThreadPool, BulkScheduleCancellation) {
+  static_thread_pool tpContext{4};
+  auto tp = tpContext.get_scheduler();
+
+  const std::size_t count = 100000;
+  std::atomic<std::size_t> calls = 0;
+
+  auto result = sync_wait(let_value_with_stop_source(
+      [&](inplace_stop_source& stopSource) {
+        return bulk_join(bulk_transform(
+            bulk_schedule(tp, count),
+            [&](std::size_t) noexcept {
+              if (++calls == 10) {
+                stopSource.request_stop();
+              }
+            },
+            par_unseq));
+      }));
+
+  // Completed with done, and every range stopped at the next chunk boundary.
+  EXPECT_FALSE(result.has_value());
+  EXPECT_LT(calls.load(), count);
+}
+
+TEST(StaticThreadPool, Partitions) {
+  static_thread_pool_options opts;
+  opts.partitions.resize(2);
+  opts.partitions[0].threadCount = 2;
+  opts.partitions[1].threadCount = 3;
+  static_thread_pool tpContext{opts};
+  EXPECT_EQ(2u, tpContext.partition_count());
+
+  std::atomic<int> x = 0;
+  sync_wait(when_all(
+      run_on(tpContext.get_partition_scheduler(0), [&] { ++x; }),
+      run_on(tpContext.get_partition_scheduler(1), [&] { ++x; }),
+      run_on(tpContext.get_scheduler(), [&] { ++x; }),
+      bulk_join(bulk_transform(
+          bulk_schedule(tpContext.get_partition_scheduler(1), 100),
+          [&](std::size_t) noexcept { ++x; },
+          par_unseq))));
+
+  EXPECT_EQ(103, x.load());
+}
+
+#if !UNIFEX_NO_EXCEPTIONS
+TEST(StaticThreadPool, InvalidOptions) {
+  {
+    // A partition without threads.
+    static_thread_pool_options opts;
+    opts.partitions.resize(2);
+    opts.partitions[0].threadCount = 2;
+    EXPECT_THROW(static_thread_pool{opts}, std::invalid_argument);
+  }
+  {
+    // Elastic mode with partitions.
+    static_thread_pool_options opts;
+    opts.partitions.resize(1);
+    opts.partitions[0].threadCount = 1;
+    opts.maxThreadCount = 2;
+    EXPECT_THROW(static_thread_pool{opts}, std::invalid_argument);
+  }
+}
+#endif
+
+#if defined(__linux__)
+TEST(StaticThreadPool, PartitionAffinity) {
+  cpu_set_t allowed;
+  ASSERT_EQ(0, ::sched_getaffinity(0, sizeof(allowed), &allowed));
+  std::uint32_t cpu = 0;
+  while (!CPU_ISSET(cpu, &allowed)) {
+    ++cpu;
+  }
+
+  static_thread_pool_options opts;
+  opts.partitions.resize(1);
+  opts.partitions[0].threadCount = 2;
+  opts.partitions[0].cpus = {cpu};
+  static_thread_pool tpContext{opts};
+
+  auto result = sync_wait(
+      run_on(tpContext.get_scheduler(), [] { return ::sched_getcpu(); }));
+  ASSERT_TRUE(result.has_value());
+  EXPECT_EQ(static_cast<int>(cpu), *result);
+}
+#endif
+
+TEST(StaticThreadPool, ScheduleAfter) {
+  using namespace std::chrono_literals;
+
+  static_thread_pool tpContext{2};
+  auto tp = tpContext.get_scheduler();
+
+  const auto start = now(tp);
+  std::thread::id threadId;
+  sync_wait(then(schedule_after(tp, 10ms), [&] {
+    threadId = std::this_thread::get_id();
+  }));
+
+  EXPECT_GE(now(tp) - start, 10ms);
+  EXPECT_NE(std::this_thread::get_id(), threadId);
+}
+
+TEST(StaticThreadPool, ScheduleAtOrder) {
+  using namespace std::chrono_literals;
+
+  static_thread_pool tpContext{1};
+  auto tp = tpContext.get_scheduler();
+
+  std::mutex mut;
+  std::vector<int> order;
+  auto record = [&](int i) {
+    return [&, i] {
+      std::lock_guard lk{mut};
+      order.push_back(i);
+    };
+  };
+
+  const auto start = now(tp);
+  sync_wait(when_all(
+      then(schedule_at(tp, start + 30ms), record(3)),
+      then(schedule_at(tp, start + 10ms), record(1)),
+      then(schedule_after(tp, 20ms), record(2))));
+
+  EXPECT_EQ((std::vector<int>{1, 2, 3}), order);
+}
+
+TEST(StaticThreadPool, ScheduleAfterCancellation) {
+  using namespace std::chrono_literals;
+
+  static_thread_pool tpContext{2};
+  auto tp = tpContext.get_scheduler();
+
+  bool sourceExecuted = false;
+  const auto start = now(tp);
+  auto result = sync_wait(stop_when(
+      then(schedule_after(tp, 10s), [&] { sourceExecuted = true; }),
+      schedule_after(tp, 10ms)));
+
+  EXPECT_FALSE(result.has_value());
+  EXPECT_FALSE(sourceExecuted);
+  EXPECT_LT(now(tp) - start, 5s);
+}
+
+TEST(StaticThreadPool, IdleStrategy) {
+  using namespace std::chrono_literals;
+
+  for (auto idle : {idle_strategy::block(), idle_strategy{}, idle_strategy{1000, 0}}) {
+    static_thread_pool_options opts;
+    opts.threadCount = 2;
+    opts.idle = idle;
+    static_thread_pool tpContext{opts};
+    auto tp = tpContext.get_scheduler();
+
+    // Let the workers go idle before each batch so that they have to be
+    // woken up again.
+    std::atomic<int> x = 0;
+    for (int i = 0; i < 10; ++i) {
+      std::this_thread::sleep_for(1ms);
+      sync_wait(when_all(
+          run_on(tp, [&] { ++x; }),
+          run_on(tp, [&] { ++x; })));
+    }
+    sync_wait(then(schedule_after(tp, 5ms), [&] { ++x; }));
+
+    EXPECT_EQ(21, x.load());
+  }
+}
+
+TEST(StaticThreadPool, Batch) {
+  for (bool workStealing : {false, true}) {
+    static_thread_pool_options opts;
+    opts.threadCount = 3;
+    opts.workStealing = workStealing;
+    static_thread_pool tpContext{opts};
+    auto tp = tpContext.get_scheduler();
+
+    async_scope scope;
+    std::atomic<int> x = 0;
+    {
+      static_thread_pool::batch batch{tp};
+      for (int i = 0; i < 100; ++i) {
+        scope.spawn(run_on(tp, [&] { ++x; }));
+      }
+      // Nothing has been submitted yet.
+      EXPECT_EQ(0, x.load());
+    }
+
+    // Batches submitted from a pool thread.
+    sync_wait(run_on(tp, [&] {
+      static_thread_pool::batch batch{tp};
+      for (int i = 0; i < 300; ++i) {
+        scope.spawn(run_on(tp, [&] { ++x; }));
+      }
+    }));
+
+    sync_wait(scope.complete());
+    EXPECT_EQ(400, x.load());
+  }
+}
+
+TEST(StaticThreadPool, Priority) {
+  static_thread_pool_options opts;
+  opts.threadCount = 1;
+  opts.starvationLimit = 4;
+  static_thread_pool tpContext{opts};
+  auto high = tpContext.get_scheduler(static_thread_pool::priority::high);
+  auto low = tpContext.get_scheduler(static_thread_pool::priority::low);
+  EXPECT_NE(high, low);
+
+  async_scope scope;
+  std::atomic<bool> started = false;
+  std::atomic<bool> release = false;
+  std::vector<char> order;
+
+  // Keep the only worker busy while the other tasks are queued up.
+  scope.spawn(run_on(tpContext.get_scheduler(), [&] {
+    started = true;
+    while (!release.load()) {
+      std::this_thread::yield();
+    }
+  }));
+  while (!started.load()) {
+    std::this_thread::yield();
+  }
+  for (int i = 0; i < 2; ++i) {
+    scope.spawn(run_on(low, [&] { order.push_back('l'); }));
+  }
+  for (int i = 0; i < 10; ++i) {
+    scope.spawn(run_on(high, [&] { order.push_back('h'); }));
+  }
+  release = true;
+  sync_wait(scope.complete());
+
+  // High priority work runs first, but a low priority task gets a turn
+  // after every starvationLimit high priority tasks.
+  EXPECT_EQ(std::string("hhhhlhhhhlhh"), std::string(order.begin(), order.end()));
+}
+
+TEST(StaticThreadPool, TimerPriority) {
+  static_thread_pool tpContext{1};
+  auto normal = tpContext.get_scheduler();
+  auto high = tpContext.get_scheduler(static_thread_pool::priority::high);
+  auto low = tpContext.get_scheduler(static_thread_pool::priority::low);
+
+  async_scope scope;
+  std::atomic<bool> started = false;
+  std::atomic<bool> release = false;
+  std::vector<char> order;
+
+  // Keep the only worker busy until the timers are due.
+  scope.spawn(run_on(normal, [&] {
+    started = true;
+    while (!release.load()) {
+      std::this_thread::yield();
+    }
+  }));
+  while (!started.load()) {
+    std::this_thread::yield();
+  }
+  for (int i = 0; i < 3; ++i) {
+    scope.spawn(run_on(normal, [&] { order.push_back('n'); }));
+  }
+  scope.spawn(
+      then(schedule_at(low, now(low)), [&] { order.push_back('l'); }));
+  scope.spawn(
+      then(schedule_at(high, now(high)), [&] { order.push_back('h'); }));
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  release = true;
+  sync_wait(scope.complete());
+
+  // Due timers run in the lane of the scheduler they were scheduled on.
+  EXPECT_EQ(std::string("hnnnl"), std::string(order.begin(), order.end()));
+}
+
+TEST(StaticThreadPool, TimerOnBusyWorker) {
+  for (bool workStealing : {false, true}) {
+    static_thread_pool_options opts;
+    opts.threadCount = 2;
+    opts.workStealing = workStealing;
+    static_thread_pool tpContext{opts};
+    auto tp = tpContext.get_scheduler();
+
+    async_scope scope;
+    std::atomic<bool> fired = false;
+    bool firedWhileBusy = false;
+
+    // The timer goes on the queue of the worker that schedules it, which
+    // then stays busy. The idle worker has to run it.
+    sync_wait(run_on(tp, [&] {
+      scope.spawn(then(schedule_after(tp, std::chrono::milliseconds(1)), [&] {
+        fired = true;
+      }));
+      const auto giveUp =
+          std::chrono::steady_clock::now() + std::chrono::seconds(5);
+      while (!fired.load() && std::chrono::steady_clock::now() < giveUp) {
+        std::this_thread::yield();
+      }
+      firedWhileBusy = fired.load();
+    }));
+    sync_wait(scope.complete());
+
+    EXPECT_TRUE(firedWhileBusy) << "workStealing=" << workStealing;
+  }
+}
+
+TEST(StaticThreadPool, RunNext) {
+  for (bool workStealing : {false, true}) {
+    for (bool runNext : {false, true}) {
+      static_thread_pool_options opts;
+      opts.threadCount = 3;
+      opts.workStealing = workStealing;
+      opts.runNext = runNext;
+      static_thread_pool tpContext{opts};
+      auto tp = tpContext.get_scheduler();
+      std::atomic<int> x = 0;
+
+      // A ping-pong between two chains, plus a fan-out from a pool thread
+      // whose tasks displace each other from the run-next slot.
+      auto chain = [&] {
+        return repeat_effect_until(
+            run_on(tp, [&] { ++x; }),
+            [n = 0]() mutable { return ++n == 1000; });
+      };
+      sync_wait(when_all(chain(), chain()));
+      sync_wait(on(
+          tp,
+          when_all(
+              run_on(tp, [&] { ++x; }),
+              run_on(tp, [&] { ++x; }),
+              run_on(tp, [&] { ++x; }))));
+
+      EXPECT_EQ(2003, x.load());
+    }
+  }
+}
+
+TEST(StaticThreadPool, Elastic) {
+  // Each task waits for the others to start, which can only happen once the
+  // pool has grown to 'count' threads.
+  struct rendezvous {
+    std::atomic<int> started = 0;
+    std::atomic<int> sawAll = 0;
+
+    auto task(int count) {
+      return [this, count] {
+        ++started;
+        const auto deadline =
+            std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (started.load() < count &&
+               std::chrono::steady_clock::now() < deadline) {
+          std::this_thread::yield();
+        }
+        if (started.load() == count) {
+          ++sawAll;
+        }
+      };
+    }
+  };
+
+  for (bool workStealing : {false, true}) {
+    static_thread_pool_options opts;
+    opts.threadCount = 1;
+    opts.maxThreadCount = 4;
+    opts.growQueueDepth = 1;
+    opts.keepAlive = std::chrono::milliseconds(20);
+    opts.workStealing = workStealing;
+    static_thread_pool tpContext{opts};
+    auto tp = tpContext.get_scheduler();
+    EXPECT_EQ(1u, tpContext.running_thread_count());
+
+    // Repeat so that some of the rounds start while the threads of the
+    // previous one are still idle rather than retired.
+    for (int round = 0; round < 20; ++round) {
+      rendezvous r;
+      sync_wait(when_all(
+          run_on(tp, r.task(4)),
+          run_on(tp, r.task(4)),
+          run_on(tp, r.task(4)),
+          run_on(tp, r.task(4))));
+      EXPECT_EQ(4, r.sawAll.load());
+      if (round % 4 == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      }
+    }
+
+    // The extra threads retire once idle.
+    const auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (tpContext.running_thread_count() > 1 &&
+           std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    EXPECT_EQ(1u, tpContext.running_thread_count());
+
+    // And the pool keeps working, growing again if needed.
+    std::atomic<int> x = 0;
+    sync_wait(when_all(
+        run_on(tp, [&] { ++x; }),
+        run_on(tp, [&] { ++x; }),
+        run_on(tp, [&] { ++x; })));
+    EXPECT_EQ(3, x.load());
+  }
+}
+
+TEST(StaticThreadPool, ElasticGrowWaitTime) {
+  for (bool workStealing : {false, true}) {
+    static_thread_pool_options opts;
+    opts.threadCount = 1;
+    opts.maxThreadCount = 2;
+    // Never backed up by depth alone, only by the task waiting in the queue
+    // while the only thread is busy.
+    opts.growQueueDepth = 100;
+    opts.growWaitTime = std::chrono::milliseconds(1);
+    opts.workStealing = workStealing;
+    static_thread_pool tpContext{opts};
+    auto tp = tpContext.get_scheduler();
+
+    std::atomic<int> started = 0;
+    std::atomic<int> sawAll = 0;
+    auto rendezvous = [&] {
+      ++started;
+      const auto deadline =
+          std::chrono::steady_clock::now() + std::chrono::seconds(10);
+      while (started.load() < 2 &&
+             std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::yield();
+      }
+      if (started.load() == 2) {
+        ++sawAll;
+      }
+    };
+    sync_wait(when_all(run_on(tp, rendezvous), run_on(tp, rendezvous)));
+    EXPECT_EQ(2, sawAll.load());
+    EXPECT_EQ(2u, tpContext.running_thread_count());
+  }
+}
+
+TEST(StaticThreadPool, Stats) {
+  static_thread_pool tpContext{2};
+  auto tp = tpContext.get_scheduler();
+  sync_wait(repeat_effect_until(
+      run_on(tp, [] {}), [n = 0]() mutable { return ++n == 100; }));
+
+  auto stats = tpContext.stats();
+  if constexpr (!static_thread_pool::stats_enabled) {
+    EXPECT_TRUE(stats.workers.empty());
+    return;
+  }
+
+  ASSERT_EQ(2u, stats.workers.size());
+  std::uint64_t executed = 0;
+  std::uint64_t latencies = 0;
+  for (auto& worker : stats.workers) {
+    executed += worker.tasksExecuted;
+    for (auto count : worker.startLatency) {
+      latencies += count;
+    }
+    if (worker.tasksExecuted != 0) {
+      EXPECT_GT(worker.busyTime.count(), 0);
+      EXPECT_GT(worker.maxQueueDepth, 0u);
+    }
+  }
+  EXPECT_EQ(100u, executed);
+  EXPECT_EQ(100u, latencies);
+}